@@ -3,13 +3,28 @@
     <define id="fields">id, username, password, email, mobile</define>
 
     <sql id="findUserById">
-        SELECT <include defineId="fields"/> FROM user WHERE id=%1
+        SELECT <include defineId="fields"/> FROM user WHERE id=:id
     </sql>
 
-    <sql id="findAll">
+    <sql id="findUsers">
+        SELECT <include defineId="fields"/> FROM user
+        <where>
+            <if test="username != null and username != ''">AND username=:username</if>
+            <if test="ids != null and ids.size > 0">
+                AND id IN <foreach collection="ids" item="id" open="(" separator="," close=")">:id</foreach>
+            </if>
+        </where>
+        ORDER BY id
+    </sql>
+
+    <sql id="findAll" cache="true" ttl="60000" tables="user">
         SELECT id, username, password, email, mobile FROM user
     </sql>
 
+    <sql id="findPage">
+        SELECT <include defineId="fields"/> FROM user WHERE {keyset} ORDER BY id LIMIT :limit
+    </sql>
+
     <sql id="insert">
         INSERT INTO user (username, password, email, mobile)
         VALUES (:username, :password, :email, :mobile)
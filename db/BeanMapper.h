@@ -0,0 +1,132 @@
+#ifndef BEANMAPPER_H
+#define BEANMAPPER_H
+
+#include <QString>
+#include <QVariant>
+#include <QVector>
+#include <QSqlQuery>
+#include <QSqlRecord>
+
+#include "db/ResultSet.h"
+
+#include <cstring>
+#include <type_traits>
+
+/**
+ * 把查询结果的列直接映射到 bean 的 setter，不经过 QVariantMap，由 DbUtil::selectBean/selectBeans/forEachBean 使用。
+ *
+ * bean 的列和 setter 只声明一次，一般放在 DAO 里函数内的静态变量中，例如
+ *      static const BeanMapper<User> &userMapper() {
+ *          static const BeanMapper<User> mapper = BeanMapper<User>()
+ *                  .bind("id", &User::setId)
+ *                  .bind("username", &User::setUsername);
+ *          return mapper;
+ *      }
+ *      QList<User> users = DbUtil::selectBeans(userMapper(), sql);
+ *
+ * 每次查询只用 resolve() 按列名解析一次列的下标，之后每一行按下标读取列的值，
+ * 转为 setter 参数的类型后直接调用 setter，没有按列名的查找和字符串的哈希。
+ * 结果中没有的列不会调用 setter，保持 bean 默认构造时的值。
+ *
+ * 声明完成后 BeanMapper 是只读的，可以在多个线程里同时使用。
+ */
+template <typename T>
+class BeanMapper
+{
+public:
+    /**
+     * @brief 声明一列映射到 bean 的 setter，setter 的参数可以是值或者 const 引用.
+     * @param column 列名（没用别名就是数据库里的列名）
+     * @param setter bean 的 setter，例如 &User::setUsername
+     * @return 自己，便于连续声明
+     */
+    template <typename V>
+    BeanMapper& bind(const QString &column, void (T::*setter)(V)) {
+        Field field;
+        field.column = column;
+        // 同一个类的成员函数指针大小和表示相同，按字节保存，由 setValue<V> 复制回原来的类型
+        static_assert(sizeof(setter) == sizeof(AnySetter), "unexpected member function pointer size");
+        std::memcpy(&field.setter, &setter, sizeof(setter));
+        field.apply = &BeanMapper::setValue<V>;
+        fields.append(field);
+        return *this;
+    }
+
+    /**
+     * @brief 解析每个字段对应的列在结果中的下标，每次查询调用一次.
+     * @param record 查询结果的 record
+     * @return 和字段顺序相同的下标，没有这一列时为 -1
+     */
+    QVector<int> resolve(const QSqlRecord &record) const {
+        QVector<int> columns(fields.size());
+        for (int i = 0; i < fields.size(); ++i) {
+            columns[i] = record.indexOf(fields.at(i).column);
+        }
+        return columns;
+    }
+
+    /**
+     * @brief 解析每个字段对应的列在 ResultSet 中的下标，用于缓存的结果.
+     */
+    QVector<int> resolve(const ResultSet &rs) const {
+        QVector<int> columns(fields.size());
+        for (int i = 0; i < fields.size(); ++i) {
+            columns[i] = rs.columnIndex(fields.at(i).column);
+        }
+        return columns;
+    }
+
+    /**
+     * @brief 把 rs 的第 row 行映射到 bean.
+     */
+    void map(const ResultSet &rs, int row, const QVector<int> &columns, T *bean) const {
+        for (int i = 0; i < fields.size(); ++i) {
+            if (columns.at(i) >= 0) {
+                const Field &field = fields.at(i);
+                field.apply(field.setter, bean, rs.value(row, columns.at(i)));
+            }
+        }
+    }
+
+    /**
+     * @brief 把 query 的当前行映射到 bean.
+     * @param query 定位到某一行的查询对象
+     * @param columns resolve() 的结果
+     * @param bean 映射的 bean
+     */
+    void map(const QSqlQuery &query, const QVector<int> &columns, T *bean) const {
+        for (int i = 0; i < fields.size(); ++i) {
+            if (columns.at(i) >= 0) {
+                const Field &field = fields.at(i);
+                field.apply(field.setter, bean, query.value(columns.at(i)));
+            }
+        }
+    }
+
+private:
+    // 保存任意参数类型的 setter，调用前由 setValue<V> 转换回原来的类型
+    typedef void (T::*AnySetter)();
+    typedef void (*Apply)(AnySetter setter, T *bean, const QVariant &value);
+
+    /**
+     * 一个列到 setter 的映射，值类型的描述符，连续的保存在 QVector 里，没有虚函数和每个字段的堆分配。
+     * apply 是编译期按 setter 的参数类型实例化的 setValue<V>，把 QVariant 转为参数类型后调用 setter。
+     */
+    struct Field {
+        QString column;
+        AnySetter setter;
+        Apply apply;
+    };
+
+    template <typename V>
+    static void setValue(AnySetter setter, T *bean, const QVariant &value) {
+        typedef typename std::decay<V>::type ValueType;
+        void (T::*typedSetter)(V);
+        std::memcpy(&typedSetter, &setter, sizeof(typedSetter));
+        (bean->*typedSetter)(qvariant_cast<ValueType>(value));
+    }
+
+    QVector<Field> fields;
+};
+
+#endif // BEANMAPPER_H
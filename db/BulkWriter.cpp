@@ -0,0 +1,221 @@
+#include "BulkWriter.h"
+
+#include <QDebug>
+#include <QHash>
+#include <QVector>
+
+static bool isMySql(const QString &driverName)
+{
+    return driverName.startsWith("QMYSQL") || driverName == "QMARIADB";
+}
+
+// 支持 ON CONFLICT 语法的驱动
+static bool supportsOnConflict(const QString &driverName)
+{
+    return driverName.startsWith("QSQLITE") || driverName == "QPSQL";
+}
+
+BulkWriter::BulkWriter(const QString &table, const QStringList &columns)
+    : table(table), columns(columns), conflictAction(ConflictError)
+{
+}
+
+BulkWriter &BulkWriter::onConflictUpdate(const QStringList &keyColumns, const QStringList &updateColumns)
+{
+    conflictAction = ConflictUpdate;
+    this->keyColumns = keyColumns;
+    this->updateColumns = updateColumns;
+    return *this;
+}
+
+BulkWriter &BulkWriter::onConflictIgnore()
+{
+    conflictAction = ConflictIgnore;
+    return *this;
+}
+
+void BulkWriter::addRow(const QVariantList &values)
+{
+    // 多的值丢掉，少的值补 NULL，保证每行的列数相同
+    for (int i = 0; i < columns.size(); ++i) {
+        this->values.append(values.value(i));
+    }
+}
+
+void BulkWriter::addRow(const QVariantMap &row)
+{
+    for (const QString &column : columns) {
+        values.append(row.value(column));
+    }
+}
+
+int BulkWriter::rowCount() const
+{
+    return columns.isEmpty() ? 0 : values.size() / columns.size();
+}
+
+void BulkWriter::clear()
+{
+    values.clear();
+}
+
+QList<BulkWriter::Statement> BulkWriter::statements(const QString &driverName, int maxParameters, int maxBytes) const
+{
+    QList<Statement> result;
+    int columnCount = columns.size();
+    int rows = rowCount();
+    if (rows == 0) {
+        return result;
+    }
+
+    if (conflictAction != ConflictError && !isMySql(driverName) && !supportsOnConflict(driverName)) {
+        qDebug() << "    => SQL Bulk Error: driver" << driverName << "does not support upsert";
+        return result;
+    }
+    if (conflictAction == ConflictUpdate
+            && (updateColumns.isEmpty() || (supportsOnConflict(driverName) && keyColumns.isEmpty()))) {
+        qDebug() << "    => SQL Bulk Error: upsert of" << table << "needs key columns and update columns";
+        return result;
+    }
+
+    if (maxParameters <= 0) {
+        maxParameters = defaultMaxParameters(driverName);
+    }
+    if (columnCount > maxParameters) {
+        // 一行也放不下，执行时只会得到驱动的错误
+        qDebug() << "    => SQL Bulk Error:" << table << "has" << columnCount << "columns, more than" << maxParameters << "parameters";
+        return result;
+    }
+    int maxRows = maxParameters / columnCount;
+
+    // 参数名只生成一次
+    QStringList names;
+    for (int i = 0; i < qMin(maxRows, rows) * columnCount; ++i) {
+        names << "p" + QString::number(i);
+    }
+
+    // 每条语句除了 VALUES 以外的部分和每个占位符大约占用的字节数
+    int baseBytes = buildSql(driverName, 1).size();
+    int placeholderBytes = 8;
+    // 前 i 行估计的字节数，用来计算任意连续几行的字节数
+    QVector<qint64> prefixBytes(rows + 1);
+    for (int row = 0; row < rows; ++row) {
+        int rowBytes = 0;
+        for (int i = 0; i < columnCount; ++i) {
+            rowBytes += placeholderBytes + estimateBytes(values.at(row * columnCount + i));
+        }
+        prefixBytes[row + 1] = prefixBytes.at(row) + rowBytes;
+    }
+
+    // 同样行数的语句文本相同，只构造一次
+    QHash<int, QString> sqls;
+    int row = 0;
+    while (row < rows) {
+        // 超过字节数的上限时行数减半而不是逐行减少，行数只有 maxRows、maxRows/2、maxRows/4 ... 和最后剩下的行数，
+        // 语句的文本种类很少，不会让每个连接的 StatementCache 里堆满只用一次的大语句；至少一行
+        int chunkRows = maxRows;
+        while (chunkRows > 1 && baseBytes + prefixBytes.at(qMin(rows, row + chunkRows)) - prefixBytes.at(row) > maxBytes) {
+            chunkRows /= 2;
+        }
+
+        Statement statement;
+        int index = 0;
+        int end = qMin(rows, row + chunkRows);
+        for (; row < end; ++row) {
+            for (int i = 0; i < columnCount; ++i) {
+                statement.params.insert(names.at(index++), values.at(row * columnCount + i));
+            }
+            ++statement.rowCount;
+        }
+
+        if (!sqls.contains(statement.rowCount)) {
+            sqls.insert(statement.rowCount, buildSql(driverName, statement.rowCount));
+        }
+        statement.sql = sqls.value(statement.rowCount);
+        result.append(statement);
+    }
+    return result;
+}
+
+int BulkWriter::defaultMaxParameters(const QString &driverName)
+{
+    if (isMySql(driverName) || driverName == "QPSQL") {
+        return 65535;
+    }
+    if (driverName == "QODBC") {
+        // SQL Server 的上限
+        return 2100;
+    }
+    // SQLite 3.32 之前 SQLITE_MAX_VARIABLE_NUMBER 的默认值，其他驱动也按这个保守的值
+    return 999;
+}
+
+QString BulkWriter::quoteIdentifier(const QString &driverName, const QString &identifier)
+{
+    QChar quote = isMySql(driverName) ? '`' : '"';
+    QStringList parts = identifier.split('.');
+    for (QString &part : parts) {
+        if (part.isEmpty() || part.startsWith(quote) || part.startsWith('[')) {
+            continue;
+        }
+        // 名字里的引号写两次
+        part = quote + QString(part).replace(quote, QString(2, quote)) + quote;
+    }
+    return parts.join('.');
+}
+
+QString BulkWriter::buildSql(const QString &driverName, int rows) const
+{
+    bool mysql = isMySql(driverName);
+    QStringList quotedColumns;
+    for (const QString &column : columns) {
+        quotedColumns << quoteIdentifier(driverName, column);
+    }
+    QString sql = (mysql && conflictAction == ConflictIgnore) ? "INSERT IGNORE INTO " : "INSERT INTO ";
+    sql += quoteIdentifier(driverName, table) + " (" + quotedColumns.join(", ") + ") VALUES ";
+
+    int index = 0;
+    for (int row = 0; row < rows; ++row) {
+        sql += row == 0 ? "(" : ", (";
+        for (int i = 0; i < columns.size(); ++i) {
+            if (i > 0) {
+                sql += ", ";
+            }
+            sql += ":p" + QString::number(index++);
+        }
+        sql += ")";
+    }
+
+    if (conflictAction == ConflictUpdate) {
+        QStringList assignments;
+        for (const QString &updateColumn : updateColumns) {
+            QString column = quoteIdentifier(driverName, updateColumn);
+            assignments << (mysql ? column + "=VALUES(" + column + ")" : column + "=excluded." + column);
+        }
+        if (mysql) {
+            sql += " ON DUPLICATE KEY UPDATE " + assignments.join(", ");
+        } else {
+            QStringList quotedKeys;
+            for (const QString &keyColumn : keyColumns) {
+                quotedKeys << quoteIdentifier(driverName, keyColumn);
+            }
+            sql += " ON CONFLICT (" + quotedKeys.join(", ") + ") DO UPDATE SET " + assignments.join(", ");
+        }
+    } else if (conflictAction == ConflictIgnore && !mysql) {
+        sql += " ON CONFLICT DO NOTHING";
+    }
+    return sql;
+}
+
+int BulkWriter::estimateBytes(const QVariant &value)
+{
+    switch (value.type()) {
+    case QVariant::ByteArray:
+        return value.toByteArray().size();
+    case QVariant::String:
+        // UTF-8 编码一个字符最多 3 个字节
+        return value.toString().size() * 3;
+    default:
+        return 16;
+    }
+}
@@ -0,0 +1,105 @@
+#ifndef BULKWRITER_H
+#define BULKWRITER_H
+
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QVariant>
+#include <QVariantList>
+#include <QVariantMap>
+
+/**
+ * 多行 INSERT 语句的构造器，由 DbUtil::bulkWrite() 执行，把很多行合并成
+ *      INSERT INTO table (a, b) VALUES (:p0, :p1), (:p2, :p3), ...
+ * 一条语句插入多行，比逐行执行 (即使是 execBatch，很多驱动也是逐行模拟的) 少很多次网络往返。
+ *
+ * 还支持冲突时更新或者忽略 (upsert)，按驱动生成不同的语法:
+ *      QMYSQL:         ON DUPLICATE KEY UPDATE col=VALUES(col) / INSERT IGNORE
+ *      QSQLITE, QPSQL: ON CONFLICT (key) DO UPDATE SET col=excluded.col / ON CONFLICT DO NOTHING
+ *
+ * 表名和列名按驱动加上引号 (MySQL 用 `name`，其他用 "name")，可以使用关键字作为列名；加了引号后 PostgreSQL 等
+ * 区分大小写，名字要和建表时的大小写一致。
+ *
+ * 一条语句的参数个数和估计的字节数有上限 (SQLite 的 SQLITE_MAX_VARIABLE_NUMBER, MySQL 的 max_allowed_packet 等)，
+ * 超过时拆分为多条语句。每条语句的行数是参数上限允许的最大行数，超过字节数的上限时依次减半，
+ * 所以行数只有 maxRows、maxRows/2、maxRows/4 ... 和最后剩下的行数几种，行数相同的语句文本相同，可以复用 prepare 过的语句。
+ *
+ * 例如:
+ *      BulkWriter writer("user", QStringList() << "id" << "username" << "email");
+ *      writer.onConflictUpdate(QStringList() << "id", QStringList() << "username" << "email");
+ *      for (const User &user : users) {
+ *          writer.addRow(QVariantList() << user.getId() << user.getUsername() << user.getEmail());
+ *      }
+ *      int affected = DbUtil::bulkWrite(writer);
+ */
+class BulkWriter
+{
+public:
+    // 冲突 (主键或者唯一键重复) 时的处理方式
+    enum ConflictAction {
+        ConflictError,  // 报错，普通的 INSERT
+        ConflictIgnore, // 忽略这一行
+        ConflictUpdate  // 更新 updateColumns
+    };
+
+    // 构造的一条语句，参数名为 p0, p1, ...
+    struct Statement {
+        QString sql;
+        QVariantMap params;
+        int rowCount;
+
+        Statement() : rowCount(0) {}
+    };
+
+    /**
+     * @param table 表名
+     * @param columns 插入的列，addRow 时每一行的值按这个顺序
+     */
+    BulkWriter(const QString &table, const QStringList &columns);
+
+    /**
+     * @brief 冲突时更新 updateColumns 为新的值.
+     * @param keyColumns 冲突的主键或者唯一键的列，ON CONFLICT 需要，MySQL 不需要
+     * @param updateColumns 要更新的列
+     */
+    BulkWriter& onConflictUpdate(const QStringList &keyColumns, const QStringList &updateColumns);
+    // 冲突时忽略这一行
+    BulkWriter& onConflictIgnore();
+
+    // 添加一行，值的顺序和 columns 相同
+    void addRow(const QVariantList &values);
+    // 添加一行，key 是列名，缺少的列为 NULL
+    void addRow(const QVariantMap &row);
+    int rowCount() const;
+    void clear();
+
+    /**
+     * @brief 按驱动的语法构造语句，每条语句不超过参数个数和字节数的上限.
+     * @param driverName 驱动名，例如 QMYSQL, QSQLITE
+     * @param maxParameters 每条语句参数个数的上限，小于等于 0 时使用驱动的默认值
+     * @param maxBytes 每条语句估计的字节数的上限
+     * @return 构造的语句，驱动不支持冲突的处理方式或者一行的列数超过参数个数的上限时返回空的 list
+     */
+    QList<Statement> statements(const QString &driverName, int maxParameters, int maxBytes) const;
+
+    // 驱动一条语句允许的参数个数
+    static int defaultMaxParameters(const QString &driverName);
+    // 按驱动的语法给表名或者列名加上引号，schema.table 每一段分别加，已经加了引号的不变
+    static QString quoteIdentifier(const QString &driverName, const QString &identifier);
+
+private:
+    // 有 rows 行时的 SQL，语法由驱动决定
+    QString buildSql(const QString &driverName, int rows) const;
+    // 估计一个值占用的字节数，宁大勿小
+    static int estimateBytes(const QVariant &value);
+
+    QString table;
+    QStringList columns;
+    ConflictAction conflictAction;
+    QStringList keyColumns;
+    QStringList updateColumns;
+    // 按行存放的值，第 row 行第 column 列在 row * columns.size() + column
+    QVariantList values;
+};
+
+#endif // BULKWRITER_H
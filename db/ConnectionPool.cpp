@@ -1,20 +1,105 @@
 #include "ConnectionPool.h"
+#include "db/LatencyHistogram.h"
+#include "db/StatementCache.h"
 #include "util/Config.h"
 
 #include <QString>
+#include <QHash>
+#include <QObject>
+#include <QEvent>
+#include <QCoreApplication>
 #include <QQueue>
 #include <QDebug>
 #include <QMutex>
+#include <QThread>
+#include <QThreadStorage>
+#include <QAtomicInt>
+#include <QAtomicPointer>
 #include <QWaitCondition>
+#include <QElapsedTimer>
 #include <QtSql/QSqlDatabase>
 #include <QtSql/QSqlQuery>
 #include <QtSql/QSqlError>
 
+/*-----------------------------------------------------------------------------|
+ |                          连接槽 的定义                                        |
+ |----------------------------------------------------------------------------*/
+
+// 连接槽的状态，所有的状态转换都通过原子操作完成
+enum SlotState {
+    SlotEmpty = 0,  // 还没有建立连接
+    SlotOpening,    // 已被某个线程占用，正在建立连接（不在锁内进行）
+    SlotIdle,       // 空闲，只能被建立它的线程借出
+    SlotInUse,      // 已被借出
+    SlotLocked,     // 暂时被占用（正在放回，或者被其他线程检查），不能借出
+    SlotRetiring    // 已被其他线程标记关闭，不再借出，由建立它的线程关闭，关闭前仍然计入最大连接数
+};
+
+// 取得连接槽的方式
+enum ClaimType {
+    ClaimOwned,     // 当前线程自己建立的空闲连接，直接复用
+    ClaimEmpty      // 空的连接槽，在当前线程建立新的连接
+};
+
+/**
+ * 连接池中的一个位置，连接池创建时按最大连接数分配好，之后不会再移动，
+ * 所以线程缓存里只保存它的下标，不加锁也可以安全的访问。
+ *
+ * 连接和建立它的线程永久绑定，owner 在建立连接时设置，关闭连接时清空，只有持有连接槽
+ * （状态不是 SlotIdle、SlotRetiring 和 SlotEmpty）的线程才会修改它，所以 CAS 成功取得连接槽后读到的 owner 是稳定的。
+ * 连接、语句缓存只在建立它的线程里使用和删除，其他线程只能把空闲的连接标记为 SlotRetiring 并通知所属的线程，不能关闭它。
+ */
+struct ConnectionSlot {
+    QString connectionName;
+    // 保存一份连接，避免每次通过 QSqlDatabase::database() 访问 Qt 全局的连接字典（它也有一把全局锁）
+    QSqlDatabase db;
+    QAtomicInt state;
+    // 建立连接的线程，连接只在这个线程里使用和关闭；为 NULL 表示所属的线程已经退出，放回时关闭
+    QAtomicPointer<QThread> owner;
+
+    // 以下时间（毫秒，连接池的单调时钟）只在持有连接槽时读写
+    // 连接建立的时间
+    qint64 createdAt;
+    // 最后一次放回连接池的时间
+    qint64 releasedAt;
+    // 最后一次验证连接有效的时间
+    qint64 validatedAt;
+    // 后台线程不能使用其他线程的连接，标记后由所属线程验证
+    bool needsValidation;
+    // 这个连接上 prepare 过的语句，和连接一起在所属的线程里创建和删除，为 NULL 时不缓存
+    StatementCache *statements;
+    // 所属线程在连接池里的状态，其他线程只在持有连接槽（SlotLocked）时通过它通知所属的线程，
+    // 所属的线程退出前会等待连接槽放回，所以这时它一定有效
+    void *ownerConnections;
+
+    ConnectionSlot() : createdAt(0), releasedAt(0), validatedAt(0), needsValidation(false), statements(NULL),
+        ownerConnections(NULL) {}
+};
+
+/**
+ * 等待连接的线程在队列里的票据，按先来后到排队。释放连接的线程直接把连接槽交给队首的票据，
+ * 并只唤醒这一个线程，避免唤醒后再和其他线程争抢。
+ */
+struct WaitTicket {
+    QThread *thread;
+    // 每个等待者有自己的条件变量，保证唤醒的就是队首的线程
+    QWaitCondition condition;
+    // 分配到的连接槽，-1 表示还没有分配
+    int slotIndex;
+    ClaimType type;
+    // 已经等待了 reclaimIdleWait，可以关闭其他线程的空闲连接给它建立连接
+    bool reclaimable;
+
+    explicit WaitTicket(QThread *t) : thread(t), slotIndex(-1), type(ClaimEmpty), reclaimable(false) {}
+};
+
 /*-----------------------------------------------------------------------------|
  |                          d指针 的定义                                        |
  |----------------------------------------------------------------------------*/
 class ConnectionPool::Private {
 public:
+    // 数据源的名字
+    QString dataSourceName;
     //数据库信息
     QString hostName;
     QString databaseName;
@@ -22,81 +107,306 @@ public:
     QString userName;
     QString password;
     int port;
+    QString connectOptions;
 
     // 取得连接的时候验证连接有效
     bool testOnBorrow;
     // 测试访问数据库的 SQL
     QString testOnBorrowSql;
+    // 连接空闲超过这个时间后，取得连接时才验证
+    int testOnBorrowIdleTime;
+    // 后台线程定时验证空闲的连接
+    bool testWhileIdle;
+    // 空闲超时和最大存活时间，为 0 时不限制
+    int idleTimeout;
+    int maxLifetime;
+    // 后台维护线程的检查间隔
+    int maintenanceInterval;
     // 获取连接最大等待时间
     int maxWaitTime;
-    int waitInterval;
+    // 等待多少毫秒后才关闭其他线程的空闲连接，为负数时不关闭
+    int reclaimIdleWait;
     // 最大连接数
     int maxConnectionCount;
+    // 最少保持的空闲连接数，启动时并行预先建立
+    int minIdle;
+    // 每个连接缓存的 prepare 过的语句数
+    int statementCacheSize;
+
+    // 保护等待队列，每个连接池一个
+    QMutex mutex;
+
+    // 所有的连接槽，个数为最大连接数，标记关闭的连接在所属线程关闭之前仍然占用连接槽
+    ConnectionSlot *slots;
+    // 标记关闭、还没有被所属线程关闭的连接数
+    QAtomicInt retiringCount;
+    // 连接名到连接槽下标的映射，创建后只读，不需要加锁
+    QHash<QString, int> slotIndexes;
+    // 每个线程在这个连接池里的状态，线程退出时析构，关闭这个线程建立的连接
+    class ThreadConnections;
+    QThreadStorage<ThreadConnections *> threadConnections;
+    // 等待连接的线程，先进先出，只在 mutex 内访问
+    QQueue<WaitTicket *> waiters;
+    // 等待连接的线程数，释放连接时不加锁就能判断是否需要移交给等待者
+    QAtomicInt waiterCount;
+
+    // 连接池的单调时钟，连接槽里的时间都相对于它
+    QElapsedTimer clock;
+    // 后台维护线程，标记超时的空闲连接和需要验证的空闲连接
+    class Maintainer;
+    Maintainer *maintainer;
 
-    static QMutex mutex;
-    static QWaitCondition waitCondition;
+    // 预热的进度，在 readyMutex 内访问：安排了预热的连接数、还没有开始预热的连接数、
+    // 还没有预热完成的连接数、预热失败的连接数
+    QMutex readyMutex;
+    QWaitCondition readyCondition;
+    int warmUpScheduled;
+    int warmUpRemaining;
+    int warmUpPending;
+    int warmUpFailed;
 
-    QQueue<QString> usedConnectionNames;
-    QQueue<QString> unUsedConnectionNames;
+    // 统计信息，只使用原子操作，不加锁
+    // 正在使用的连接数和它的最大值
+    QAtomicInt inUseCount;
+    QAtomicInt maxInUse;
+    QAtomicInteger<qint64> borrowCount;
+    // 等待超时的次数
+    QAtomicInteger<qint64> timeoutCount;
+    // 连接失效后重新建立连接的次数
+    QAtomicInteger<qint64> reconnectCount;
+    // 标记关闭其他线程的空闲连接的次数
+    QAtomicInteger<qint64> reclaimCount;
+    // 建立连接失败的次数
+    QAtomicInteger<qint64> connectFailureCount;
+    // 语句缓存命中和没有命中的次数
+    QAtomicInteger<qint64> statementCacheHits;
+    QAtomicInteger<qint64> statementCacheMisses;
+    // 取得连接时等待的时间和建立连接的耗时，单位微秒
+    LatencyHistogram borrowWaitHistogram;
+    LatencyHistogram creationHistogram;
 
-    Private();
+    explicit Private(const QString &dataSourceName);
     ~Private();
 
     QSqlDatabase createConnection(const QString &connectionName);
+    // 当前线程在这个连接池里的状态，第一次调用时创建
+    ThreadConnections* localConnections(QThread *thread);
+    // 从线程缓存中取得连接，不加锁
+    int claimCachedSlot(QThread *thread);
+    // 查找当前线程建立的空闲连接，找不到返回 -1；locked 为 true 表示调用前已经持有 mutex
+    int claimOwnedSlot(QThread *thread, bool locked = false);
+    // 查找一个空的连接槽，找不到返回 -1
+    int claimEmptySlot();
+    // 查找当前线程可以使用的连接槽，找不到返回 -1（调用前持有 mutex）
+    int claimSlotLocked(QThread *thread, ClaimType *type);
+    // 排队等待连接槽，超过最大等待时间返回 -1
+    int waitForSlot(QThread *thread, ClaimType *type);
+    // 达到最大连接数时，把其他线程的一个空闲连接标记关闭，找不到返回 false
+    bool reclaimIdleSlot(QThread *thread);
+    // 把空闲的连接标记关闭并通知所属的线程，成功返回 true
+    bool markRetiring(int index);
+    // 最早等待的线程等了 reclaimIdleWait 时，标记关闭下标为 index（为 -1 时查找一个）的其他线程的空闲连接，
+    // 所属线程关闭后空出的连接槽交给等待的线程（调用前持有 mutex）
+    void reclaimForWaiterLocked(int index);
+    // 通知连接所属的线程处理它被标记的连接（调用前持有连接槽）
+    void notifyOwner(ConnectionSlot &slot);
+    // 当前线程有被标记的连接时处理它们，没有时只读取一个线程局部的标志
+    void serviceLocalSlots(QThread *thread);
+    // 在所属的线程里处理它被标记的连接：关闭标记关闭的连接，验证需要验证的空闲连接
+    void serviceThreadSlots(QThread *thread);
+    // 在持有的标记关闭的连接槽上关闭连接，连接槽变为空的（在连接所属的线程调用）
+    void retireMarkedSlot(int index);
+    // 空的连接槽交给最早等待的线程建立连接（调用前持有 mutex）
+    void offerEmptySlotLocked();
+    // 把持有的连接槽交给等待的线程并唤醒它（调用前持有 mutex）
+    void assignSlot(WaitTicket *ticket, int index, ClaimType type);
+    // 线程退出时关闭它建立的连接
+    void closeThreadSlots(QThread *thread);
+    // 在当前线程准备好取得的连接槽里的连接，失败时关闭连接、释放连接槽并返回无效的连接，调用者可以再取得其他的连接
+    QSqlDatabase checkout(int index, ClaimType type, QThread *thread);
+    // 复用的连接是否需要在取得时验证
+    bool needsBorrowTest(const ConnectionSlot &slot) const;
+    // 验证连接槽里的连接是否有效，失效时尝试重新打开
+    bool testConnection(ConnectionSlot &slot);
+    // 关闭连接槽里的连接，连接槽变为空的（调用前必须已经持有连接槽，连接没有被使用）
+    void retireSlot(ConnectionSlot &slot);
+    // 释放连接槽，状态变为 available（SlotIdle 或 SlotEmpty），有线程在等待时直接移交：
+    // 空闲的连接交给建立它的线程，没有这样的等待者、最早等待的线程已经等了 reclaimIdleWait 时标记关闭，名额交给它
+    void releaseSlot(int index, int available);
+    // 同 releaseSlot()，调用前已经持有 mutex，用于 waitForSlot() 等在锁内释放连接槽的地方
+    void releaseSlotLocked(int index, int available);
+    // 把刚释放的连接槽移交给等待的线程（调用前持有 mutex）
+    void handOffLocked(int index, int available);
+    // 在维护线程里检查所有空闲的连接，空闲超时的连接标记关闭，需要验证的也只标记，通知连接所属的线程处理
+    void maintainIdleSlots();
+    // 有 threadCount 个线程会调用 warmUp()，安排其中最多 minIdle 个预热，返回这次安排的个数
+    int scheduleWarmUp(int threadCount);
+    // 在当前线程预热一个连接，放入当前线程的缓存，没有安排预热或者建立失败返回 false
+    bool warmUp();
+    // 一个预热连接建立完成
+    void finishWarmUp(bool ok);
+    // 等待安排了的预热完成
+    bool waitWarmUp(int timeout);
+    // 停止维护线程
+    void stopBackgroundThreads();
+    // 在当前线程取得连接，slotIndex 返回连接槽的下标
+    QSqlDatabase borrow(int *slotIndex);
+    // 把连接槽放回连接池
+    void giveBack(int slotIndex);
+    // 借出一个连接后更新统计
+    void recordBorrowed();
+};
+
+/**
+ * 后台维护线程，每隔 maintenanceInterval 毫秒检查一次空闲的连接。
+ */
+class ConnectionPool::Private::Maintainer : public QThread {
+public:
+    explicit Maintainer(ConnectionPool::Private *d) : d(d), stopping(false) {}
+
+    void stop() {
+        QMutexLocker locker(&mutex);
+        stopping = true;
+        condition.wakeOne();
+    }
+
+protected:
+    void run() Q_DECL_OVERRIDE {
+        QMutexLocker locker(&mutex);
+        while (!stopping) {
+            condition.wait(&mutex, static_cast<unsigned long>(d->maintenanceInterval));
+            if (stopping) {
+                break;
+            }
+            locker.unlock();
+            d->maintainIdleSlots();
+            locker.relock();
+        }
+    }
+
+private:
+    ConnectionPool::Private *d;
+    QMutex mutex;
+    QWaitCondition condition;
+    bool stopping;
+};
+
+/**
+ * 线程在一个连接池里的状态。QThreadStorage 在线程退出时析构它，这时在这个线程里关闭它建立的连接，
+ * 并清空连接槽的 owner，之后即使新的线程分配到相同的地址，也不会取得已退出线程的连接。
+ *
+ * 它在所属的线程里创建，其他线程标记了这个线程的连接后给它发送事件：线程运行着事件循环时马上在这个线程里处理，
+ * 否则在这个线程下次取得连接时处理。
+ */
+class ConnectionPool::Private::ThreadConnections : public QObject {
+public:
+    ThreadConnections(ConnectionPool::Private *d, QThread *thread) : cachedIndex(-1), d(d), thread(thread) {}
+    ~ThreadConnections() {
+        d->closeThreadSlots(thread);
+    }
+
+    static QEvent::Type serviceEventType() {
+        static const int type = QEvent::registerEventType();
+        return static_cast<QEvent::Type>(type);
+    }
+
+    // 最近一次放回的连接槽的下标，-1 表示没有
+    int cachedIndex;
+    // 有被标记的连接需要处理
+    QAtomicInt pending;
+    // 已经发送了事件还没有处理，没有事件循环的线程最多积压一个事件
+    QAtomicInt eventQueued;
+
+protected:
+    bool event(QEvent *e) Q_DECL_OVERRIDE {
+        if (e->type() != serviceEventType()) {
+            return QObject::event(e);
+        }
+        eventQueued.storeRelease(0);
+        if (pending.fetchAndStoreOrdered(0) != 0) {
+            d->serviceThreadSlots(thread);
+        }
+        return true;
+    }
 
+private:
+    ConnectionPool::Private *d;
+    QThread *thread;
 };
 
-ConnectionPool::Private::Private()
+ConnectionPool::Private::Private(const QString &dataSourceName) : dataSourceName(dataSourceName)
 {
     //获取配置实例
     Config &config = Singleton<Config>::getInstance();
 
-    //从配置中获取数据库信息
-    hostName = config.getDatabaseHost();
-    databaseName = config.getDatabaseName();
-    databaseType = config.getDatabaseType();
-    userName = config.getDatabaseUsername();
-    password = config.getDatabasePassword();
+    //从配置中获取数据源的数据库信息
+    hostName = config.getDatabaseHost(dataSourceName);
+    databaseName = config.getDatabaseName(dataSourceName);
+    databaseType = config.getDatabaseType(dataSourceName);
+    userName = config.getDatabaseUsername(dataSourceName);
+    password = config.getDatabasePassword(dataSourceName);
 
-    port = config.getDatabaseport();
-    testOnBorrow = config.getDatabaseTestOnBorrow();
-    testOnBorrowSql = config.getDatabaseTestOnBorrowSql();
-    maxWaitTime = config.getDatabaseMaxWaitTime();
-    waitInterval = config.getDatabaseWaitInterval();
-    maxConnectionCount = config.getDatabaseMaxConnectionCount();
+    port = config.getDatabaseport(dataSourceName);
+    connectOptions = config.getDatabaseConnectOptions(dataSourceName);
+    testOnBorrow = config.getDatabaseTestOnBorrow(dataSourceName);
+    testOnBorrowSql = config.getDatabaseTestOnBorrowSql(dataSourceName);
+    testOnBorrowIdleTime = config.getDatabaseTestOnBorrowIdleTime(dataSourceName);
+    testWhileIdle = config.getDatabaseTestWhileIdle(dataSourceName);
+    idleTimeout = config.getDatabaseIdleTimeout(dataSourceName);
+    maxLifetime = config.getDatabaseMaxLifetime(dataSourceName);
+    maintenanceInterval = config.getDatabaseMaintenanceInterval(dataSourceName);
+    maxWaitTime = config.getDatabaseMaxWaitTime(dataSourceName);
+    reclaimIdleWait = config.getDatabaseReclaimIdleWait(dataSourceName);
+    maxConnectionCount = config.getDatabaseMaxConnectionCount(dataSourceName);
+    minIdle = qBound(0, config.getDatabaseMinIdle(dataSourceName), maxConnectionCount);
+    statementCacheSize = config.getDatabaseStatementCacheSize(dataSourceName);
+
+    slots = new ConnectionSlot[maxConnectionCount];
+    for (int i = 0; i < maxConnectionCount; ++i) {
+        // 连接名包含数据源的名字，多个连接池的连接不会重名
+        slots[i].connectionName = QString("%1-Connection-%2").arg(dataSourceName).arg(i + 1);
+        slotIndexes.insert(slots[i].connectionName, i);
+    }
+
+    clock.start();
+
+    // 连接由使用它们的线程在自己的线程里预热，由 DbExecutor 或者程序自己的请求线程用 scheduleWarmUp() 安排
+    warmUpScheduled = 0;
+    warmUpRemaining = 0;
+    warmUpPending = 0;
+    warmUpFailed = 0;
+
+    maintainer = NULL;
+    if (maintenanceInterval > 0 && (testWhileIdle || idleTimeout > 0 || maxLifetime > 0)) {
+        maintainer = new Maintainer(this);
+        maintainer->start();
+    }
 }
 
 ConnectionPool::Private::~Private()
 {
-    //销毁连接池的时候删除所有的连接
-    for(QString connectionName : usedConnectionNames) {
-        QSqlDatabase::removeDatabase(connectionName);
-    }
-    for(QString connectionName : unUsedConnectionNames) {
-        QSqlDatabase::removeDatabase(connectionName);
+    stopBackgroundThreads();
+    // 当前线程建立的连接在这里关闭，其他线程的 ThreadConnections 随 threadConnections 一起失效，退出时不再访问连接池
+    threadConnections.setLocalData(NULL);
+
+    //销毁连接池的时候删除所有的连接，这时使用连接池的其他线程应该都已经停止了
+    for (int i = 0; i < maxConnectionCount; ++i) {
+        if (slots[i].state.load() != SlotEmpty) {
+            retireSlot(slots[i]);
+        }
     }
+    delete[] slots;
+    slots = NULL;
 }
 
 QSqlDatabase ConnectionPool::Private::createConnection(const QString &connectionName)
 {
     Q_ASSERT(!connectionName.isEmpty());
-    // 连接已经创建过了，复用它，而不是重新创建
-    if (QSqlDatabase::contains(connectionName)) {
-        QSqlDatabase unUsedDb = QSqlDatabase::database(connectionName);
-        if (testOnBorrow) {
-            // 返回连接前访问数据库，如果连接断开，重新建立连接
-            qDebug() << "Test connection on borrow, execute："
-                     << testOnBorrowSql << ", for" << connectionName;
-            QSqlQuery query(testOnBorrowSql, unUsedDb);
-            if (query.lastError().type() != QSqlError::NoError && !unUsedDb.open()) {
-                qDebug() << "Open databse error：" << query.lastError().text();
-                return QSqlDatabase();
-            }
-        }
-        return unUsedDb;
-    }
 
-    // 创建一个新的连接
+    QElapsedTimer timer;
+    timer.start();
+
+    // 创建一个新的连接，连接属于调用此函数的线程
     QSqlDatabase newDb = QSqlDatabase::addDatabase(databaseType, connectionName);
     newDb.setHostName(hostName);
     newDb.setDatabaseName(databaseName);
@@ -105,92 +415,735 @@ QSqlDatabase ConnectionPool::Private::createConnection(const QString &connection
     if (port != 0) {
         newDb.setPort(port);
     }
+    if (!connectOptions.isEmpty()) {
+        newDb.setConnectOptions(connectOptions);
+    }
 
-    if (!newDb.open()) {
+    bool opened = newDb.open();
+    creationHistogram.record(timer.nsecsElapsed() / 1000);
+    if (!opened) {
+        connectFailureCount.fetchAndAddRelaxed(1);
         qDebug() << "Open database error：" << newDb.lastError().text();
         return QSqlDatabase();
     }
     return newDb;
 }
 
-QMutex ConnectionPool::Private::mutex;
-QWaitCondition ConnectionPool::Private::waitCondition;
+ConnectionPool::Private::ThreadConnections *ConnectionPool::Private::localConnections(QThread *thread)
+{
+    if (!threadConnections.hasLocalData()) {
+        threadConnections.setLocalData(new ThreadConnections(this, thread));
+    }
+    return threadConnections.localData();
+}
+
+int ConnectionPool::Private::claimCachedSlot(QThread *thread)
+{
+    if (!threadConnections.hasLocalData()) {
+        return -1;
+    }
+    int index = threadConnections.localData()->cachedIndex;
+    if (index < 0) {
+        return -1;
+    }
+
+    ConnectionSlot &slot = slots[index];
+    if (!slot.state.testAndSetAcquire(SlotIdle, SlotInUse)) {
+        return -1;
+    }
+    if (slot.owner.loadAcquire() != thread) {
+        // 缓存的连接已经关闭，连接槽被其他线程重新建立了连接，不属于当前线程
+        threadConnections.localData()->cachedIndex = -1;
+        releaseSlot(index, SlotIdle);
+        return -1;
+    }
+    return index;
+}
+
+int ConnectionPool::Private::claimOwnedSlot(QThread *thread, bool locked)
+{
+    // 其他线程建立的连接不能在当前线程使用，只查找当前线程自己的
+    for (int i = 0; i < maxConnectionCount; ++i) {
+        if (slots[i].owner.loadAcquire() != thread || !slots[i].state.testAndSetAcquire(SlotIdle, SlotInUse)) {
+            continue;
+        }
+        // 取得连接槽后 owner 不会再被其他线程修改，重新确认一次
+        if (slots[i].owner.loadAcquire() == thread) {
+            return i;
+        }
+        // 在 waitForSlot() 里调用时已经持有 mutex，不能再加锁
+        if (locked) {
+            releaseSlotLocked(i, SlotIdle);
+        } else {
+            releaseSlot(i, SlotIdle);
+        }
+    }
+    return -1;
+}
+
+int ConnectionPool::Private::claimEmptySlot()
+{
+    // 没有达到最大连接数，在当前线程建立新的连接；标记关闭的连接在关闭前仍然占用连接槽
+    for (int i = 0; i < maxConnectionCount; ++i) {
+        if (slots[i].state.testAndSetAcquire(SlotEmpty, SlotOpening)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int ConnectionPool::Private::claimSlotLocked(QThread *thread, ClaimType *type)
+{
+    int index = claimOwnedSlot(thread, true);
+    if (index >= 0) {
+        *type = ClaimOwned;
+        return index;
+    }
+    *type = ClaimEmpty;
+    return claimEmptySlot();
+}
+
+int ConnectionPool::Private::waitForSlot(QThread *thread, ClaimType *type)
+{
+    // 使用单调时钟计算真实的等待时间，不受系统时间调整的影响
+    QElapsedTimer timer;
+    timer.start();
+
+    QMutexLocker locker(&mutex);
+    WaitTicket ticket(thread);
+    bool queueWasEmpty = waiters.isEmpty();
+    waiters.enqueue(&ticket);
+    waiterCount.fetchAndAddOrdered(1);
+
+    // 没有其他线程在排队时，登记后再查找一次，避免错过登记之前释放的连接；
+    // 已经有线程在排队时不插队，等待释放连接的线程按顺序移交
+    if (queueWasEmpty) {
+        int index = claimSlotLocked(thread, type);
+        if (ticket.slotIndex >= 0) {
+            // 查找时放回的连接槽已经移交给了自己（已出队），多取得的连接槽放回去
+            if (index >= 0) {
+                releaseSlotLocked(index, *type == ClaimOwned ? SlotIdle : SlotEmpty);
+            }
+            *type = ticket.type;
+            return ticket.slotIndex;
+        }
+        if (index >= 0) {
+            waiters.removeOne(&ticket);
+            waiterCount.fetchAndAddOrdered(-1);
+            return index;
+        }
+    }
+    qint64 remaining = maxWaitTime;
+    while (ticket.slotIndex < 0 && remaining > 0) {
+        qint64 timeout = remaining;
+        if (!ticket.reclaimable && reclaimIdleWait >= 0) {
+            qint64 untilReclaim = reclaimIdleWait - timer.elapsed();
+            if (untilReclaim <= 0) {
+                // 等了 reclaimIdleWait 还没有自己的连接或者空的连接槽，其他线程的空闲连接不能跨线程使用，
+                // 标记关闭并通知所属的线程，它关闭后空出的连接槽按顺序交给最早等待的线程
+                ticket.reclaimable = true;
+                reclaimForWaiterLocked(-1);
+                continue;
+            }
+            timeout = qMin(timeout, untilReclaim);
+        }
+        //阻塞，期间其他线程可以使用 mutex 锁，等待唤醒，唤醒后继续加锁，执行后续代码
+        ticket.condition.wait(&mutex, static_cast<unsigned long>(timeout));
+        remaining = maxWaitTime - timer.elapsed();
+    }
+
+    if (ticket.slotIndex < 0) {
+        // 超时，从队列中移除，释放连接的线程在 mutex 内移交，所以这里不会漏掉已经分配的连接槽
+        waiters.removeOne(&ticket);
+        waiterCount.fetchAndAddOrdered(-1);
+        return -1;
+    }
+    *type = ticket.type;
+    return ticket.slotIndex;
+}
+
+bool ConnectionPool::Private::reclaimIdleSlot(QThread *thread)
+{
+    for (int i = 0; i < maxConnectionCount; ++i) {
+        QThread *owner = slots[i].owner.loadAcquire();
+        if (owner != NULL && owner != thread && markRetiring(i)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ConnectionPool::Private::reclaimForWaiterLocked(int index)
+{
+    if (waiters.isEmpty()) {
+        return;
+    }
+    bool marked = index < 0 ? reclaimIdleSlot(waiters.head()->thread) : markRetiring(index);
+    if (marked) {
+        reclaimCount.fetchAndAddRelaxed(1);
+    }
+}
+
+bool ConnectionPool::Private::markRetiring(int index)
+{
+    ConnectionSlot &slot = slots[index];
+    // 连接和语句缓存只能在所属的线程里删除，这里只做标记，持有连接槽时通知所属的线程
+    if (!slot.state.testAndSetAcquire(SlotIdle, SlotLocked)) {
+        return false;
+    }
+    retiringCount.fetchAndAddOrdered(1);
+    notifyOwner(slot);
+    slot.state.storeRelease(SlotRetiring);
+    return true;
+}
+
+void ConnectionPool::Private::notifyOwner(ConnectionSlot &slot)
+{
+    ThreadConnections *connections = static_cast<ThreadConnections *>(slot.ownerConnections);
+    connections->pending.storeRelease(1);
+    // 线程运行着事件循环时马上处理，没有事件循环的线程最多积压一个事件，下次取得连接时处理
+    if (connections->eventQueued.testAndSetOrdered(0, 1)) {
+        QCoreApplication::postEvent(connections, new QEvent(ThreadConnections::serviceEventType()));
+    }
+}
+
+void ConnectionPool::Private::serviceLocalSlots(QThread *thread)
+{
+    if (threadConnections.hasLocalData() && threadConnections.localData()->pending.loadAcquire() != 0
+            && threadConnections.localData()->pending.fetchAndStoreOrdered(0) != 0) {
+        serviceThreadSlots(thread);
+    }
+}
+
+void ConnectionPool::Private::serviceThreadSlots(QThread *thread)
+{
+    for (int i = 0; i < maxConnectionCount; ++i) {
+        ConnectionSlot &slot = slots[i];
+        if (slot.owner.loadAcquire() != thread) {
+            continue;
+        }
+        if (slot.state.testAndSetAcquire(SlotRetiring, SlotLocked)) {
+            retireMarkedSlot(i);
+        } else if (slot.state.testAndSetAcquire(SlotIdle, SlotLocked)) {
+            // test_while_idle 标记的连接在所属的线程里验证，失效并且重新打开失败时关闭
+            if (slot.needsValidation && !testConnection(slot)) {
+                retireSlot(slot);
+                releaseSlot(i, SlotEmpty);
+            } else {
+                releaseSlot(i, SlotIdle);
+            }
+        }
+    }
+}
+
+void ConnectionPool::Private::retireMarkedSlot(int index)
+{
+    // 关闭后才不计入最大连接数，空出的连接槽交给等待的线程
+    retireSlot(slots[index]);
+    retiringCount.fetchAndAddOrdered(-1);
+    releaseSlot(index, SlotEmpty);
+}
+
+void ConnectionPool::Private::offerEmptySlotLocked()
+{
+    if (waiters.isEmpty()) {
+        return;
+    }
+    int index = claimEmptySlot();
+    if (index >= 0) {
+        assignSlot(waiters.dequeue(), index, ClaimEmpty);
+    }
+}
+
+void ConnectionPool::Private::assignSlot(WaitTicket *ticket, int index, ClaimType type)
+{
+    waiterCount.fetchAndAddOrdered(-1);
+    ticket->slotIndex = index;
+    ticket->type = type;
+    ticket->condition.wakeOne();
+}
+
+void ConnectionPool::Private::closeThreadSlots(QThread *thread)
+{
+    for (int i = 0; i < maxConnectionCount; ++i) {
+        ConnectionSlot &slot = slots[i];
+        while (slot.owner.loadAcquire() == thread) {
+            if (slot.state.testAndSetAcquire(SlotIdle, SlotLocked)) {
+                retireSlot(slot);
+                releaseSlot(i, SlotEmpty);
+                break;
+            }
+            if (slot.state.testAndSetAcquire(SlotRetiring, SlotLocked)) {
+                retireMarkedSlot(i);
+                break;
+            }
+            int state = slot.state.loadAcquire();
+            if (state == SlotInUse) {
+                // 线程退出前没有释放连接，只能在放回时关闭
+                qDebug() << "Connection" << slot.connectionName << "is not returned before its thread exits";
+                slot.owner.storeRelease(NULL);
+                break;
+            }
+            if (state != SlotLocked) {
+                break;
+            }
+            // 其他线程正在检查这个连接槽，很快就会放回
+            QThread::yieldCurrentThread();
+        }
+    }
+}
+
+QSqlDatabase ConnectionPool::Private::checkout(int index, ClaimType type, QThread *thread)
+{
+    ConnectionSlot &slot = slots[index];
+
+    if (type == ClaimOwned) {
+        if (maxLifetime > 0 && clock.elapsed() - slot.createdAt >= maxLifetime) {
+            // 超过最大存活时间，在当前线程关闭后重新建立
+            retireSlot(slot);
+        } else if (!needsBorrowTest(slot) || testConnection(slot)) {
+            return slot.db;
+        } else {
+            retireSlot(slot);
+            releaseSlot(index, SlotEmpty);
+            return QSqlDatabase();
+        }
+    }
+
+    // 创建连接，因为创建连接很耗时，所以不放在 lock 的范围内，提高并发效率
+    QSqlDatabase db = createConnection(slot.connectionName);
+    if (!db.isOpen()) {
+        QSqlDatabase::removeDatabase(slot.connectionName);
+        releaseSlot(index, SlotEmpty);
+        return QSqlDatabase();
+    }
+
+    // 有效的连接才放入连接槽，连接和当前线程绑定，线程退出时关闭
+    slot.ownerConnections = localConnections(thread);
+    slot.db = db;
+    if (statementCacheSize > 0) {
+        // 语句缓存和连接一样只在当前线程里使用
+        slot.statements = new StatementCache(statementCacheSize, &statementCacheHits, &statementCacheMisses);
+    }
+    slot.createdAt = slot.releasedAt = slot.validatedAt = clock.elapsed();
+    slot.needsValidation = false;
+    slot.owner.storeRelease(thread);
+    slot.state.storeRelease(SlotInUse);
+    return db;
+}
+
+bool ConnectionPool::Private::needsBorrowTest(const ConnectionSlot &slot) const
+{
+    if (slot.needsValidation) {
+        return true;
+    }
+    // 刚用过的连接不再验证，避免每次取得连接都多一次访问数据库
+    return testOnBorrow && clock.elapsed() - slot.releasedAt >= testOnBorrowIdleTime;
+}
+
+bool ConnectionPool::Private::testConnection(ConnectionSlot &slot)
+{
+    // 访问数据库，如果连接断开，重新建立连接
+    QSqlQuery query(testOnBorrowSql, slot.db);
+    if (query.lastError().type() != QSqlError::NoError) {
+        reconnectCount.fetchAndAddRelaxed(1);
+        // 重新打开连接后原来 prepare 的语句都失效了
+        query.clear();
+        if (slot.statements != NULL) {
+            slot.statements->clear();
+        }
+        if (!slot.db.open()) {
+            qDebug() << "Open databse error：" << slot.db.lastError().text();
+            return false;
+        }
+    }
+    slot.validatedAt = clock.elapsed();
+    slot.needsValidation = false;
+    return true;
+}
+
+void ConnectionPool::Private::retireSlot(ConnectionSlot &slot)
+{
+    // 缓存的语句依赖于连接，先删除
+    delete slot.statements;
+    slot.statements = NULL;
+    slot.db = QSqlDatabase();
+    QSqlDatabase::removeDatabase(slot.connectionName);
+    slot.ownerConnections = NULL;
+    slot.owner.storeRelease(NULL);
+}
+
+void ConnectionPool::Private::releaseSlot(int index, int available)
+{
+    // 先发布连接槽再读取等待者个数，和等待者先登记再查找对应，二者至少有一方能看到对方
+    slots[index].state.fetchAndStoreOrdered(available);
+    if (waiterCount.fetchAndAddOrdered(0) == 0) {
+        return;
+    }
+
+    QMutexLocker locker(&mutex);
+    handOffLocked(index, available);
+}
+
+void ConnectionPool::Private::releaseSlotLocked(int index, int available)
+{
+    slots[index].state.fetchAndStoreOrdered(available);
+    handOffLocked(index, available);
+}
+
+void ConnectionPool::Private::handOffLocked(int index, int available)
+{
+    ConnectionSlot &slot = slots[index];
+    if (waiters.isEmpty()) {
+        return;
+    }
+    if (available == SlotIdle) {
+        // 空闲的连接只能交给建立它的线程
+        QThread *owner = slot.owner.loadAcquire();
+        for (int i = 0; i < waiters.size(); ++i) {
+            if (waiters.at(i)->thread == owner) {
+                if (slot.state.testAndSetAcquire(SlotIdle, SlotInUse)) {
+                    assignSlot(waiters.takeAt(i), index, ClaimOwned);
+                }
+                return;
+            }
+        }
+        // 等待的线程都不能使用这个连接：最早等待的线程已经等了 reclaimIdleWait 时才标记关闭，
+        // 所属的线程关闭后再交给等待的线程；否则留给所属的线程复用，避免每次移交都重新建立连接
+        if (waiters.head()->reclaimable) {
+            reclaimForWaiterLocked(index);
+        }
+        return;
+    }
+    // 空的连接槽交给最早等待的线程
+    offerEmptySlotLocked();
+}
+
+void ConnectionPool::Private::maintainIdleSlots()
+{
+    // 没有标记关闭的连接数，空闲超时关闭连接时保留 minIdle 个
+    int openCount = 0;
+    for (int i = 0; i < maxConnectionCount; ++i) {
+        int state = slots[i].state.loadAcquire();
+        if (state != SlotEmpty && state != SlotOpening && state != SlotRetiring) {
+            ++openCount;
+        }
+    }
+
+    for (int i = 0; i < maxConnectionCount; ++i) {
+        ConnectionSlot &slot = slots[i];
+        // 先取得连接槽再检查，避免和借出连接的线程冲突，正在使用的连接不检查
+        if (!slot.state.testAndSetAcquire(SlotIdle, SlotLocked)) {
+            continue;
+        }
+
+        qint64 now = clock.elapsed();
+        if (idleTimeout > 0 && now - slot.releasedAt >= idleTimeout && openCount > minIdle) {
+            // 连接和语句缓存只能在所属的线程里删除，这里只标记关闭并通知所属的线程
+            --openCount;
+            retiringCount.fetchAndAddOrdered(1);
+            notifyOwner(slot);
+            slot.state.storeRelease(SlotRetiring);
+            continue;
+        }
+        if (testWhileIdle && now - slot.validatedAt >= maintenanceInterval) {
+            // 验证需要执行 SQL，连接只能在建立它的线程里使用，标记后通知所属的线程验证
+            slot.needsValidation = true;
+            notifyOwner(slot);
+        }
+        // 超过 maxLifetime 的连接由所属线程取得时关闭后重新建立，不需要标记
+        releaseSlot(i, SlotIdle);
+    }
+}
+
+int ConnectionPool::Private::scheduleWarmUp(int threadCount)
+{
+    QMutexLocker locker(&readyMutex);
+    int count = qBound(0, threadCount, minIdle - warmUpScheduled);
+    warmUpScheduled += count;
+    warmUpRemaining += count;
+    warmUpPending += count;
+    if (warmUpScheduled < minIdle) {
+        qDebug() << QString("Only %1 of min_idle=%2 connections of %3 can be warmed up, add async workers")
+                    .arg(warmUpScheduled).arg(minIdle).arg(dataSourceName);
+    }
+    return count;
+}
+
+bool ConnectionPool::Private::warmUp()
+{
+    {
+        QMutexLocker locker(&readyMutex);
+        if (warmUpRemaining == 0) {
+            return false;
+        }
+        --warmUpRemaining;
+    }
+
+    // 连接在当前线程建立，属于当前线程，不会交给其他线程使用
+    QThread *thread = QThread::currentThread();
+    ClaimType type = ClaimOwned;
+    int index = claimOwnedSlot(thread);
+    if (index < 0) {
+        type = ClaimEmpty;
+        index = claimEmptySlot();
+    }
+
+    bool ok = false;
+    if (index >= 0 && checkout(index, type, thread).isValid()) {
+        // 没有借出，直接放入当前线程的缓存
+        slots[index].releasedAt = clock.elapsed();
+        localConnections(thread)->cachedIndex = index;
+        releaseSlot(index, SlotIdle);
+        ok = true;
+    }
+    finishWarmUp(ok);
+    return ok;
+}
+
+void ConnectionPool::Private::finishWarmUp(bool ok)
+{
+    QMutexLocker locker(&readyMutex);
+    --warmUpPending;
+    if (!ok) {
+        ++warmUpFailed;
+    }
+    if (warmUpPending == 0) {
+        readyCondition.wakeAll();
+    }
+}
+
+bool ConnectionPool::Private::waitWarmUp(int timeout)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    QMutexLocker locker(&readyMutex);
+    // 只等待已经安排的预热，没有线程会预热的连接不等待，直接返回
+    qint64 remaining = timeout;
+    while (warmUpPending > 0 && remaining > 0) {
+        readyCondition.wait(&readyMutex, static_cast<unsigned long>(remaining));
+        remaining = timeout - timer.elapsed();
+    }
+    return warmUpPending == 0 && warmUpFailed == 0 && warmUpScheduled == minIdle;
+}
+
+QSqlDatabase ConnectionPool::Private::borrow(int *slotIndex)
+{
+    QThread *thread = QThread::currentThread();
+    QElapsedTimer timer;
+    timer.start();
+
+    // 其他线程标记关闭的本线程的连接在这里关闭，没有时只读取一个线程局部的标志
+    serviceLocalSlots(thread);
+
+    // 快速路径：当前线程缓存着空闲的连接，直接复用，不需要加锁
+    int index = claimCachedSlot(thread);
+    if (index >= 0) {
+        borrowWaitHistogram.record(timer.nsecsElapsed() / 1000);
+        QSqlDatabase db = checkout(index, ClaimOwned, thread);
+        if (db.isValid()) {
+            *slotIndex = index;
+            recordBorrowed();
+            return db;
+        }
+        // 缓存的连接失效并且重新打开失败，连接槽已经空出，继续查找其他连接或者建立新的连接
+        timer.start();
+    }
+
+    forever {
+        // 慢速路径：当前线程的其他空闲连接只有它自己能用，可以直接取得；
+        // 建立新的连接时如果已经有线程在排队，直接排到队尾，不插队
+        ClaimType type = ClaimOwned;
+        index = claimOwnedSlot(thread);
+        if (index < 0 && waiterCount.loadAcquire() == 0) {
+            type = ClaimEmpty;
+            index = claimEmptySlot();
+        }
+        if (index < 0) {
+            index = waitForSlot(thread, &type);
+        }
+        borrowWaitHistogram.record(timer.nsecsElapsed() / 1000);
+
+        if (index < 0) {
+            // 已经达到最大连接数，且在最长等待时间内其他线程无释放连接
+            timeoutCount.fetchAndAddRelaxed(1);
+            qDebug() << "Cannot create more connections";
+            // 创建连接超时，返回一个无效连接
+            return QSqlDatabase();
+        }
+        QSqlDatabase db = checkout(index, type, thread);
+        if (db.isValid()) {
+            *slotIndex = index;
+            recordBorrowed();
+            return db;
+        }
+        if (type == ClaimEmpty) {
+            // 建立新的连接也失败了，数据库不可用
+            return db;
+        }
+        // 复用的连接失效，连接槽已经空出，每次都关闭一个失效的连接，所以重试的次数有限
+        timer.start();
+    }
+}
+
+void ConnectionPool::Private::recordBorrowed()
+{
+    borrowCount.fetchAndAddRelaxed(1);
+    int inUse = inUseCount.fetchAndAddRelaxed(1) + 1;
+    int currentMax = maxInUse.load();
+    while (inUse > currentMax && !maxInUse.testAndSetRelaxed(currentMax, inUse, currentMax)) {
+    }
+}
+
+void ConnectionPool::Private::giveBack(int slotIndex)
+{
+    ConnectionSlot &slot = slots[slotIndex];
+    // 同一个连接被放回多次时只有第一次有效
+    if (!slot.state.testAndSetOrdered(SlotInUse, SlotLocked)) {
+        return;
+    }
+    inUseCount.fetchAndAddRelaxed(-1);
+    slot.releasedAt = clock.elapsed();
+
+    QThread *thread = QThread::currentThread();
+    QThread *owner = slot.owner.loadAcquire();
+    if (owner == NULL) {
+        // 所属的线程已经退出，关闭后空出连接槽
+        retireSlot(slot);
+        releaseSlot(slotIndex, SlotEmpty);
+        return;
+    }
+    if (owner == thread) {
+        // 放入当前线程的缓存，下次本线程获取连接时不需要加锁
+        localConnections(thread)->cachedIndex = slotIndex;
+    }
+    releaseSlot(slotIndex, SlotIdle);
+}
+
+void ConnectionPool::Private::stopBackgroundThreads()
+{
+    if (maintainer != NULL) {
+        maintainer->stop();
+        maintainer->wait();
+        delete maintainer;
+        maintainer = NULL;
+    }
+}
 
 /*-----------------------------------------------------------------------------|
  |                             ConnectionPool 的定义                            |
  |----------------------------------------------------------------------------*/
 
-ConnectionPool::ConnectionPool() : d(new ConnectionPool::Private)
+ConnectionPool::ConnectionPool(const QString &dataSourceName) : d(new ConnectionPool::Private(dataSourceName))
 {
 
 }
 
 ConnectionPool::~ConnectionPool()
 {
+    release();
 }
 
 void ConnectionPool::release()
 {
-    QMutexLocker locker(&ConnectionPool::Private::mutex);
+    if (d == NULL) {
+        return;
+    }
+    // 先停止维护线程，它释放连接槽的时候也需要加锁
+    d->stopBackgroundThreads();
+    QString dataSourceName = d->dataSourceName;
     //删除私有指针，会调用 Private 析构函数，删除池中所有的连接
     delete d;
     d = NULL;
-    qDebug() << "Destroy connection pool";
+    qDebug() << "Destroy connection pool" << dataSourceName;
+}
+
+QString ConnectionPool::dataSourceName() const
+{
+    return d->dataSourceName;
+}
+
+int ConnectionPool::activeConnectionCount() const
+{
+    return d->inUseCount.load();
+}
+
+void ConnectionPool::serviceConnections()
+{
+    d->serviceLocalSlots(QThread::currentThread());
+}
+
+int ConnectionPool::scheduleWarmUp(int threadCount)
+{
+    return d->scheduleWarmUp(threadCount);
+}
+
+bool ConnectionPool::warmUp()
+{
+    return d->warmUp();
+}
+
+bool ConnectionPool::waitUntilReady(int timeout)
+{
+    return d->waitWarmUp(timeout);
 }
 
 QSqlDatabase ConnectionPool::openConnection()
 {
-    QString connectionName;
-    //加锁
-    ConnectionPool::Private::mutex.lock();
-    // 已创建连接数
-    int connectionCount = d->usedConnectionNames.size() + d->unUsedConnectionNames.size();
-    //需要一直阻塞等待的条件：未到最大等待时间；未使用的连接为0；当前连接总数等于最大连接数
-    //满足所有条件，则阻塞当前线程，等待其他线程释放连接
-    for (int i=0; i<d->maxWaitTime && d->unUsedConnectionNames.size() == 0
-         && connectionCount == d->maxConnectionCount ; i+=d->waitInterval) {
-        //阻塞，期间其他线程可以使用 mutex 锁，等待唤醒，唤醒后继续加锁，执行后续代码
-        ConnectionPool::Private::waitCondition.wait(&ConnectionPool::Private::mutex, d->waitInterval);
-        // 重新计算已创建连接数
-        connectionCount = d->usedConnectionNames.size() + d->unUsedConnectionNames.size();
-    }
-    if (d->unUsedConnectionNames.size() > 0) {
-        // 有已经回收的连接，复用它们
-        connectionName = d->unUsedConnectionNames.dequeue();
-    } else if (connectionCount < d->maxConnectionCount) {
-        // 没有已经回收的连接，但是没有达到最大连接数，则创建新的连接
-        connectionName = QString("Connection-%1").arg(connectionCount + 1);
-    } else {
-        // 已经达到最大连接数，且在最长等待时间内其他线程无释放连接
-        qDebug() << "Cannot create more connections";
-        // 创建连接超时，返回一个无效连接
-        return QSqlDatabase();
-    }
-    //解锁
-    ConnectionPool::Private::mutex.unlock();
-    // 创建连接，因为创建连接很耗时，所以不放在 lock 的范围内，提高并发效率
-    QSqlDatabase db = d->createConnection(connectionName);
+    int slotIndex = -1;
+    return d->borrow(&slotIndex);
+}
 
-    if (db.isOpen()) {
-        ConnectionPool::Private::mutex.lock();
-        // 有效的连接才放入 usedConnectionNames
-        d->usedConnectionNames.enqueue(connectionName);
-        ConnectionPool::Private::mutex.unlock();
+void ConnectionPool::closeConnection(const QSqlDatabase &connection)
+{
+    // 如果不是我们创建的连接（例如获取连接失败时得到的无效连接），直接忽略
+    int slotIndex = d->slotIndexes.value(connection.connectionName(), -1);
+    if (slotIndex < 0) {
+        return;
     }
-    return db;
+    // 已经放回的连接由 giveBack() 忽略
+    d->giveBack(slotIndex);
 }
 
-void ConnectionPool::closeConnection(const QSqlDatabase &connection)
+PooledConnection ConnectionPool::borrowConnection()
 {
-    QString connectionName = connection.connectionName();
-    // 如果是我们创建的连接，从 used 里删除，放入 unused 里
-    if (d->usedConnectionNames.contains(connectionName)) {
-        QMutexLocker locker(&ConnectionPool::Private::mutex);
-        d->usedConnectionNames.removeOne(connectionName);
-        d->unUsedConnectionNames.enqueue(connectionName);
-        //唤醒所有线程，此时阻塞的 QWaitCondition 会被唤醒
-        ConnectionPool::Private::waitCondition.wakeOne();
+    int slotIndex = -1;
+    QSqlDatabase db = d->borrow(&slotIndex);
+    if (!db.isValid()) {
+        return PooledConnection();
     }
+    return PooledConnection(this, slotIndex, db, d->slots[slotIndex].statements);
 }
 
+void ConnectionPool::returnConnection(int slotIndex)
+{
+    d->giveBack(slotIndex);
+}
 
+PoolMetrics ConnectionPool::metrics() const
+{
+    PoolMetrics metrics;
+    for (int i = 0; i < d->maxConnectionCount; ++i) {
+        int state = d->slots[i].state.load();
+        if (state == SlotIdle || state == SlotInUse || state == SlotLocked || state == SlotRetiring) {
+            ++metrics.totalConnections;
+        }
+    }
+    metrics.retiringConnections = qMin(d->retiringCount.load(), metrics.totalConnections);
+    metrics.activeConnections = qMin(d->inUseCount.load(), metrics.totalConnections - metrics.retiringConnections);
+    metrics.idleConnections = metrics.totalConnections - metrics.activeConnections - metrics.retiringConnections;
+    metrics.waitingThreads = d->waiterCount.load();
+    metrics.maxConnectionCount = d->maxConnectionCount;
+    metrics.maxInUse = d->maxInUse.load();
+    metrics.borrowCount = d->borrowCount.load();
+    metrics.timeoutCount = d->timeoutCount.load();
+    metrics.reconnectCount = d->reconnectCount.load();
+    metrics.reclaimCount = d->reclaimCount.load();
+    metrics.connectFailureCount = d->connectFailureCount.load();
+    metrics.statementCacheHits = d->statementCacheHits.load();
+    metrics.statementCacheMisses = d->statementCacheMisses.load();
+    metrics.borrowWait = d->borrowWaitHistogram.snapshot();
+    metrics.connectionCreation = d->creationHistogram.snapshot();
+    return metrics;
+}
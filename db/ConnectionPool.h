@@ -1,10 +1,53 @@
 #ifndef CONNECTIONPOOL_H
 #define CONNECTIONPOOL_H
 
-#include "util/Singleton.h"
+#include "db/PooledConnection.h"
+#include "db/LatencyHistogram.h"
+
+#include <QString>
 
 class QSqlDatabase;
 
+/**
+ * 连接池某一时刻的统计信息，由 ConnectionPool::metrics() 返回，用来确定合适的 max_connection_count。
+ */
+struct PoolMetrics {
+    // 已建立的连接数、正在使用的连接数、空闲的连接数
+    int totalConnections;
+    int activeConnections;
+    int idleConnections;
+    // 已标记关闭、等待所属线程关闭的连接数，关闭前仍然计入 totalConnections 和最大连接数
+    int retiringConnections;
+    // 正在排队等待连接的线程数
+    int waitingThreads;
+    // 最大连接数，以及同时使用的连接数的最大值
+    int maxConnectionCount;
+    int maxInUse;
+
+    // 借出连接的次数
+    qint64 borrowCount;
+    // 等待超过 max_wait_time 没有取得连接的次数
+    qint64 timeoutCount;
+    // 连接失效后重新建立连接的次数
+    qint64 reconnectCount;
+    // 等待的线程把其他线程的空闲连接标记关闭、自己建立新连接的次数
+    qint64 reclaimCount;
+    // 建立连接失败的次数
+    qint64 connectFailureCount;
+    // 语句缓存命中和没有命中的次数
+    qint64 statementCacheHits;
+    qint64 statementCacheMisses;
+
+    // 取得连接时等待的时间，单位微秒
+    LatencyHistogram::Snapshot borrowWait;
+    // 建立连接的耗时，单位微秒
+    LatencyHistogram::Snapshot connectionCreation;
+
+    PoolMetrics() : totalConnections(0), activeConnections(0), idleConnections(0), retiringConnections(0), waitingThreads(0),
+        maxConnectionCount(0), maxInUse(0), borrowCount(0), timeoutCount(0), reconnectCount(0), reclaimCount(0),
+        connectFailureCount(0), statementCacheHits(0), statementCacheMisses(0) {}
+};
+
 /**
  * 实现了一个简易的数据库连接池，简化了数据库连接的获取。通过配置最大的连接数可创建多个连接支持多线程访问数据库，
  * Qt 里同一个数据库连接不能被多个线程共享。连接使用完后释放回连接池而不是直接关闭，再次使用的时候不必重新建立连接，
@@ -17,34 +60,100 @@ class QSqlDatabase;
  * 如果 testOnBorrow 为 false，则连接断开后不会自动重新连接，这时获取到的连接调用 QSqlDatabase::isOpen() 返回的值
  * 仍然是 true（因为先前的时候已经建立好了连接，Qt 里没有提供判断底层连接断开的方法或者信号）。
  *
- * 当程序结束后，需要调用 Singleton<ConnectionPool>::getInstance().destroy() 关闭所有数据库的连接（一般在 main() 函数返回前调用）。
+ * 为了避免每次取得连接都多访问一次数据库，只有连接空闲超过 test_on_borrow_idle_time 毫秒后取得时才验证。
+ * 后台维护线程每隔 maintenance_interval 毫秒检查一次空闲的连接：空闲超过 idle_timeout 的连接标记关闭（保留 min_idle 个），
+ * 由所属线程关闭（见下面的连接和线程绑定）；连接不能在其他线程里使用，所以 test_while_idle 为 true 时也只做标记，
+ * 同样由所属的线程验证。
+ * 建立超过 max_lifetime 的连接在所属线程下次取得时关闭后重新建立。
+ *
+ * 连接和线程绑定：Qt 里连接只能在创建它的线程中使用，所以连接永久属于建立它的线程，只会借给这个线程。
+ * 每个线程缓存最近释放的连接，下次在同一个线程获取连接时直接复用，不需要加连接池的全局锁；
+ * 没有空闲的连接时在当前线程建立新的连接。已达到最大连接数时，等待的线程只接收属于自己的连接或者空的连接槽，
+ * 最多等待 max_wait_time，所以访问数据库的线程数（包括 DbExecutor 的工作线程）应不超过 max_connection_count。
+ * 线程数更多时可以把 reclaim_idle_wait 设为非负数（默认 -1 不启用）：等待超过这么多毫秒后，把其他线程的一个空闲连接标记为关闭，
+ * 之后其他线程放回的连接不属于任何等待者时也这样处理。每次这样取得连接都要建立新的连接（QMYSQL 下是 TCP 连接加认证），
+ * 被关闭连接的线程下次也要重新建立，会增加取得连接的延迟，PoolMetrics::reclaimCount 和 connectionCreation 能看到这个开销。
+ *
+ * 连接和它的语句缓存只在建立它的线程里关闭：标记关闭的连接不再借出，连接池通知所属的线程，运行事件循环的线程
+ * 马上在自己的线程里关闭，DbExecutor 的工作线程空闲时定时调用 serviceConnections() 处理，其他线程在下次取得连接、
+ * 调用 serviceConnections() 或者退出时关闭。关闭之前它仍然占用连接槽、计入最大连接数，
+ * 所以同时存在的连接永远不超过 max_connection_count；所属线程长时间不访问连接池又没有事件循环时，等待的线程只能等到超时。
+ * 线程退出时在这个线程里关闭它建立的连接。
+ *
+ * 达到最大连接数时，获取连接的线程按先来后到排队，最多等待 max_wait_time 毫秒（按真实经过的时间计算），
+ * 释放连接的线程把连接直接交给最早等待的线程并只唤醒它。
+ *
+ * 预热：连接只能在使用它的线程里建立和使用，连接池自己的线程建立的连接其他线程用不到，所以连接池不会自己预热，
+ * 由将要使用连接的线程预热：先调用 scheduleWarmUp() 安排有多少个线程预热，这些线程再各自调用 warmUp() 在自己的线程里
+ * 建立一个连接，一共最多 min_idle 个，避免启动后的第一批请求串行的等待建立连接。DbExecutor 启动工作线程时会这样预热；
+ * 在自己的请求线程里同步访问数据库时，由程序在启动请求线程之前安排，例如：
+ *    ConnectionPool &pool = Singleton<DataSourceManager>::getInstance().primary();
+ *    pool.scheduleWarmUp(requestThreadCount);
+ *    // 每个请求线程开始处理请求之前
+ *    pool.warmUp();
+ *    // 主线程等待预热完成后再报告服务就绪
+ *    if (pool.waitUntilReady(5000)) { ... }
+ * 安排预热的线程比 min_idle 少时只预热这些线程个数的连接。既没有启动 DbExecutor 也没有自己安排预热时连接池不预热，
+ * waitUntilReady() 只等待安排了的预热，这时立即返回 false。后台维护线程关闭空闲连接时会保留 min_idle 个。
+ *
+ * 每个数据源（主库和每个读库）有一个连接池，由 DataSourceManager 统一创建和管理。
+ * 当程序结束后，需要调用 Singleton<DataSourceManager>::getInstance().release() 关闭所有数据库的连接（一般在 main() 函数返回前调用）。
  *
  * 使用方法：
  * 1. 从数据库连接池里取得连接
- *    QSqlDatabase db = Singleton<ConnectionPool>::getInstance().openConnection();
+ *    ConnectionPool &pool = Singleton<DataSourceManager>::getInstance().primary();
+ *    QSqlDatabase db = pool.openConnection();
  *
  * 2. 使用 db 访问数据库，如
  *    QSqlQuery query(db);
  *
  * 3. 数据库连接使用完后需要释放回数据库连接池
- *    Singleton<ConnectionPool>::getInstance().closeConnection(db);
+ *    pool.closeConnection(db);
  *
- * 4. 程序结束的时候真正的关闭所有数据库连接
- *    Singleton<ConnectionPool>::getInstance().destroy();
+ * 推荐使用 borrowConnection() 取得连接，返回的 PooledConnection 离开作用域时自动释放回连接池，
+ * 即使中途 return 或者抛出异常也不会漏掉释放，也不会重复释放：
+ *    PooledConnection connection = pool.borrowConnection();
+ *    QSqlQuery query(connection.database());
  */
 class ConnectionPool
 {
-    SINGLETON(ConnectionPool)
-
 public:
+    // 使用 config.json 中数据源 dataSourceName 的配置创建连接池
+    explicit ConnectionPool(const QString &dataSourceName);
+    ~ConnectionPool();
+
+    // 数据源的名字
+    QString dataSourceName() const;
+    // 正在使用的连接数，只读取原子变量，用于选择最空闲的读库
+    int activeConnectionCount() const;
     //关闭连接池
     void release();
+    //安排预热，之后有 threadCount 个线程会各自调用 warmUp()，最多安排 min_idle 个，返回这次安排的个数
+    int scheduleWarmUp(int threadCount);
+    //在当前线程预热一个连接，之后本线程取得连接时直接使用；没有安排预热或者建立失败时返回 false
+    bool warmUp();
+    //等待安排了的预热完成，min_idle 个连接全部建立成功（min_idle 为 0 时不需要预热）返回 true；
+    //超时、有连接建立失败或者安排预热的线程不足 min_idle 个时返回 false，没有安排预热时立即返回 false
+    bool waitUntilReady(int timeout);
+    //在当前线程关闭被标记关闭的连接、验证 test_while_idle 标记的连接，没有时只读取一个线程局部的标志；
+    //没有事件循环、又会长时间不取得连接的线程应定时调用
+    void serviceConnections();
     //获取数据库连接
     QSqlDatabase openConnection();
     //释放数据库连接回连接池
     void closeConnection(const QSqlDatabase &connection);
+    //获取数据库连接，返回的 PooledConnection 析构时自动释放回连接池
+    PooledConnection borrowConnection();
+    //取得连接池的统计信息，只读取原子变量，不加锁
+    PoolMetrics metrics() const;
 
 private:
+    Q_DISABLE_COPY(ConnectionPool)
+
+    friend class PooledConnection;
+    //按连接槽的下标释放连接回连接池，只由 PooledConnection 调用
+    void returnConnection(int slotIndex);
+
     class Private;
     friend class Private;
     Private *d;
@@ -0,0 +1,158 @@
+#include "DataSourceManager.h"
+#include "db/ConnectionPool.h"
+#include "util/Config.h"
+
+#include <QDebug>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QAtomicInt>
+#include <QThreadStorage>
+#include <QElapsedTimer>
+
+/*-----------------------------------------------------------------------------|
+ |                          d指针 的定义                                        |
+ |----------------------------------------------------------------------------*/
+class DataSourceManager::Private {
+public:
+    ConnectionPool *primaryPool;
+    QList<ConnectionPool *> replicaPools;
+    // 数据源名字到连接池的映射，创建后只读
+    QHash<QString, ConnectionPool *> pools;
+    QStringList names;
+
+    // 为 true 时选择正在使用的连接最少的读库，否则轮询
+    bool leastBusy;
+    // 轮询的计数
+    QAtomicInt nextReplica;
+    // 当前线程嵌套的 PrimaryReadScope 的层数
+    QThreadStorage<int> primaryReadDepth;
+
+    Private();
+    ~Private();
+
+    ConnectionPool& selectReplica();
+};
+
+DataSourceManager::Private::Private()
+{
+    Config &config = Singleton<Config>::getInstance();
+
+    primaryPool = new ConnectionPool(Config::PRIMARY_DATA_SOURCE);
+    pools.insert(Config::PRIMARY_DATA_SOURCE, primaryPool);
+    names << Config::PRIMARY_DATA_SOURCE;
+
+    for (const QString &name : config.getDatabaseReplicaNames()) {
+        ConnectionPool *replica = new ConnectionPool(name);
+        replicaPools.append(replica);
+        pools.insert(name, replica);
+        names << name;
+    }
+
+    leastBusy = config.getDatabaseReadStrategy() == "least_busy";
+    qDebug() << "Data sources:" << names;
+}
+
+DataSourceManager::Private::~Private()
+{
+    qDeleteAll(replicaPools);
+    delete primaryPool;
+}
+
+ConnectionPool &DataSourceManager::Private::selectReplica()
+{
+    if (leastBusy) {
+        ConnectionPool *best = replicaPools.first();
+        for (ConnectionPool *replica : replicaPools) {
+            if (replica->activeConnectionCount() < best->activeConnectionCount()) {
+                best = replica;
+            }
+        }
+        return *best;
+    }
+
+    // fetchAndAdd 返回值溢出后可能为负数，转为无符号数再取余
+    unsigned int next = static_cast<unsigned int>(nextReplica.fetchAndAddRelaxed(1));
+    return *replicaPools.at(static_cast<int>(next % static_cast<unsigned int>(replicaPools.size())));
+}
+
+/*-----------------------------------------------------------------------------|
+ |                          DataSourceManager 的定义                            |
+ |----------------------------------------------------------------------------*/
+
+DataSourceManager::DataSourceManager() : d(new DataSourceManager::Private)
+{
+}
+
+DataSourceManager::~DataSourceManager()
+{
+    release();
+}
+
+ConnectionPool &DataSourceManager::primary()
+{
+    return *d->primaryPool;
+}
+
+ConnectionPool &DataSourceManager::pool(const QString &name)
+{
+    ConnectionPool *pool = d->pools.value(name);
+    if (pool == NULL) {
+        qDebug() << "Cannot find data source" << name << ", use primary";
+        return *d->primaryPool;
+    }
+    return *pool;
+}
+
+ConnectionPool &DataSourceManager::poolFor(AccessMode mode)
+{
+    // 写操作、没有读库、或者当前线程要求读主库时使用主库
+    if (mode == WriteAccess || d->replicaPools.isEmpty()
+            || (d->primaryReadDepth.hasLocalData() && d->primaryReadDepth.localData() > 0)) {
+        return *d->primaryPool;
+    }
+    return d->selectReplica();
+}
+
+QStringList DataSourceManager::dataSourceNames() const
+{
+    return d->names;
+}
+
+bool DataSourceManager::waitUntilReady(int timeout)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    bool ready = true;
+    for (const QString &name : d->names) {
+        int remaining = qMax(0, timeout - static_cast<int>(timer.elapsed()));
+        ready = d->pools.value(name)->waitUntilReady(remaining) && ready;
+    }
+    return ready;
+}
+
+void DataSourceManager::release()
+{
+    if (d == NULL) {
+        return;
+    }
+    //删除私有指针，会删除所有的连接池
+    delete d;
+    d = NULL;
+}
+
+/*-----------------------------------------------------------------------------|
+ |                          PrimaryReadScope 的定义                             |
+ |----------------------------------------------------------------------------*/
+
+PrimaryReadScope::PrimaryReadScope()
+{
+    ++Singleton<DataSourceManager>::getInstance().d->primaryReadDepth.localData();
+}
+
+PrimaryReadScope::~PrimaryReadScope()
+{
+    --Singleton<DataSourceManager>::getInstance().d->primaryReadDepth.localData();
+}
@@ -0,0 +1,74 @@
+#ifndef DATASOURCEMANAGER_H
+#define DATASOURCEMANAGER_H
+
+#include "util/Singleton.h"
+
+class ConnectionPool;
+class QString;
+class QStringList;
+
+/**
+ * 管理所有数据源的连接池：config.json 中 database 下配置的主库，以及 database.replicas 下配置的多个读库，
+ * 每个数据源一个 ConnectionPool，创建 DataSourceManager 时一起创建。
+ *
+ * 读写分离：写操作（insert、update）使用主库，读操作（select*）使用读库，
+ * 有多个读库时按 database.read_strategy 选择：round_robin 轮询，least_busy 选正在使用的连接最少的；
+ * 没有配置读库时读写都使用主库。
+ *
+ * 主从同步有延迟，刚写入的数据马上从读库读取可能读不到，这时在作用域内定义一个 PrimaryReadScope，
+ * 当前线程在作用域内的读操作也使用主库:
+ *     DbUtil::insert(sql, params);
+ *     {
+ *         PrimaryReadScope readFromPrimary;
+ *         DbUtil::selectMap(...); // 从主库读取
+ *     }
+ *
+ * 程序结束前需要调用 Singleton<DataSourceManager>::getInstance().release() 关闭所有数据库的连接。
+ */
+class DataSourceManager
+{
+    SINGLETON(DataSourceManager)
+
+public:
+    // 访问数据库的方式，决定使用哪个数据源
+    enum AccessMode {
+        ReadAccess,
+        WriteAccess
+    };
+
+    // 主库的连接池
+    ConnectionPool& primary();
+    // 名字为 name 的数据源的连接池，不存在时返回主库的
+    ConnectionPool& pool(const QString &name);
+    // 按访问方式选择连接池
+    ConnectionPool& poolFor(AccessMode mode);
+    // 所有数据源的名字，第一个是主库
+    QStringList dataSourceNames() const;
+
+    // 等待所有连接池预热完成，预热由 DbExecutor::start() 或者程序自己的请求线程安排，参考 ConnectionPool::waitUntilReady()
+    bool waitUntilReady(int timeout);
+    // 关闭所有的连接池
+    void release();
+
+private:
+    friend class PrimaryReadScope;
+
+    class Private;
+    friend class Private;
+    Private *d;
+};
+
+/**
+ * 在作用域内，当前线程的读操作也使用主库，用于读取刚写入的数据，可以嵌套使用。
+ */
+class PrimaryReadScope
+{
+public:
+    PrimaryReadScope();
+    ~PrimaryReadScope();
+
+private:
+    Q_DISABLE_COPY(PrimaryReadScope)
+};
+
+#endif // DATASOURCEMANAGER_H
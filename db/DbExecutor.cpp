@@ -0,0 +1,214 @@
+#include "DbExecutor.h"
+#include "db/ConnectionPool.h"
+#include "db/DataSourceManager.h"
+#include "util/Config.h"
+
+#include <QDebug>
+#include <QList>
+#include <QQueue>
+#include <QMutex>
+#include <QStringList>
+#include <QThread>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+
+/*-----------------------------------------------------------------------------|
+ |                          d指针 的定义                                        |
+ |----------------------------------------------------------------------------*/
+class DbExecutor::Private {
+public:
+    class Worker;
+
+    int workerCount;
+    int capacity;
+    int submitTimeout;
+    // 空闲的工作线程每隔这么多毫秒处理一次连接池标记的本线程的连接，为 0 时不处理
+    int serviceInterval;
+
+    // 以下成员在 mutex 内访问
+    mutable QMutex mutex;
+    QWaitCondition notEmpty;
+    QWaitCondition notFull;
+    QQueue<std::function<void()> > tasks;
+    QList<Worker *> workers;
+    bool stopping;
+
+    Private();
+
+    // 在 mutex 内调用，第一次提交任务时启动工作线程
+    void startWorkers();
+    // 在工作线程里预热每个连接池的连接
+    void warmUpConnections();
+    // 在工作线程里处理每个连接池标记的本线程的连接（空闲超时关闭、test_while_idle 验证）
+    void serviceConnections();
+    // 工作线程取得下一个任务，已经停止并且队列为空时返回 false
+    bool takeTask(std::function<void()> *task);
+};
+
+/**
+ * 工作线程，不断从队列中取出任务执行。
+ */
+class DbExecutor::Private::Worker : public QThread {
+public:
+    explicit Worker(DbExecutor::Private *d) : d(d) {}
+
+protected:
+    void run() Q_DECL_OVERRIDE {
+        // 连接属于建立它的线程，在工作线程里预热，之后执行任务时直接使用
+        d->warmUpConnections();
+
+        std::function<void()> task;
+        while (d->takeTask(&task)) {
+            // 异常离开 QThread::run() 会调用 std::terminate()，这里拦截，工作线程继续执行后面的任务
+            try {
+                task();
+            } catch (...) {
+                qDebug() << "DbExecutor task threw an exception in" << objectName();
+            }
+            task = std::function<void()>();
+        }
+    }
+
+private:
+    DbExecutor::Private *d;
+};
+
+DbExecutor::Private::Private() : stopping(false)
+{
+    Config &config = Singleton<Config>::getInstance();
+    workerCount = qMax(1, config.getDatabaseAsyncWorkerCount());
+    capacity = qMax(1, config.getDatabaseAsyncQueueCapacity());
+    submitTimeout = qMax(0, config.getDatabaseAsyncSubmitTimeout());
+    serviceInterval = qMax(0, config.getDatabaseMaintenanceInterval());
+}
+
+void DbExecutor::Private::startWorkers()
+{
+    if (!workers.isEmpty()) {
+        return;
+    }
+    // 先安排预热再启动工作线程，waitUntilReady() 不会因为工作线程还没有运行而漏掉它们的预热
+    DataSourceManager &manager = Singleton<DataSourceManager>::getInstance();
+    for (const QString &name : manager.dataSourceNames()) {
+        manager.pool(name).scheduleWarmUp(workerCount);
+    }
+    for (int i = 0; i < workerCount; ++i) {
+        Worker *worker = new Worker(this);
+        worker->setObjectName(QString("DbWorker-%1").arg(i + 1));
+        workers.append(worker);
+        worker->start();
+    }
+}
+
+void DbExecutor::Private::warmUpConnections()
+{
+    DataSourceManager &manager = Singleton<DataSourceManager>::getInstance();
+    for (const QString &name : manager.dataSourceNames()) {
+        manager.pool(name).warmUp();
+    }
+}
+
+void DbExecutor::Private::serviceConnections()
+{
+    DataSourceManager &manager = Singleton<DataSourceManager>::getInstance();
+    for (const QString &name : manager.dataSourceNames()) {
+        manager.pool(name).serviceConnections();
+    }
+}
+
+bool DbExecutor::Private::takeTask(std::function<void()> *task)
+{
+    QMutexLocker locker(&mutex);
+    while (tasks.isEmpty() && !stopping) {
+        if (serviceInterval <= 0) {
+            notEmpty.wait(&mutex);
+        } else if (!notEmpty.wait(&mutex, static_cast<unsigned long>(serviceInterval))) {
+            // 工作线程没有事件循环，空闲时连接池的维护线程标记的连接只能由它自己定时关闭或者验证
+            locker.unlock();
+            serviceConnections();
+            locker.relock();
+        }
+    }
+    if (tasks.isEmpty()) {
+        return false;
+    }
+    *task = tasks.dequeue();
+    notFull.wakeOne();
+    return true;
+}
+
+/*-----------------------------------------------------------------------------|
+ |                             DbExecutor 的定义                                |
+ |----------------------------------------------------------------------------*/
+
+DbExecutor::DbExecutor() : d(new DbExecutor::Private)
+{
+}
+
+DbExecutor::~DbExecutor()
+{
+    release();
+    delete d;
+    d = NULL;
+}
+
+void DbExecutor::start()
+{
+    QMutexLocker locker(&d->mutex);
+    if (!d->stopping) {
+        d->startWorkers();
+    }
+}
+
+bool DbExecutor::submit(const std::function<void()> &task)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    QMutexLocker locker(&d->mutex);
+    if (d->stopping) {
+        qDebug() << "DbExecutor is released, task rejected";
+        return false;
+    }
+    d->startWorkers();
+
+    // 队列满时等待工作线程取走任务，最多等待 submitTimeout 毫秒
+    qint64 remaining = d->submitTimeout;
+    while (d->tasks.size() >= d->capacity && remaining > 0 && !d->stopping) {
+        d->notFull.wait(&d->mutex, static_cast<unsigned long>(remaining));
+        remaining = d->submitTimeout - timer.elapsed();
+    }
+    if (d->tasks.size() >= d->capacity || d->stopping) {
+        qDebug() << "DbExecutor queue is full, task rejected";
+        return false;
+    }
+
+    d->tasks.enqueue(task);
+    d->notEmpty.wakeOne();
+    return true;
+}
+
+int DbExecutor::pendingCount() const
+{
+    QMutexLocker locker(&d->mutex);
+    return d->tasks.size();
+}
+
+void DbExecutor::release()
+{
+    QList<Private::Worker *> workers;
+    {
+        QMutexLocker locker(&d->mutex);
+        d->stopping = true;
+        d->notEmpty.wakeAll();
+        d->notFull.wakeAll();
+        workers = d->workers;
+        d->workers.clear();
+    }
+
+    // 工作线程执行完队列中剩下的任务后退出
+    for (Private::Worker *worker : workers) {
+        worker->wait();
+        delete worker;
+    }
+}
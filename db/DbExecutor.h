@@ -0,0 +1,44 @@
+#ifndef DBEXECUTOR_H
+#define DBEXECUTOR_H
+
+#include "util/Singleton.h"
+
+#include <functional>
+
+/**
+ * 执行异步 SQL 的工作线程池，DbUtil 的 *Async 函数把任务提交到这里执行。
+ *
+ * 工作线程数由 database.async_worker_count 配置，调用 start() 或者第一次提交任务时启动。每个工作线程通过连接池的线程缓存
+ * 一直使用自己的连接，满足 Qt 里连接只能在创建它的线程中使用的要求。启动工作线程时
+ * 给每个连接池安排预热（ConnectionPool::scheduleWarmUp()），工作线程启动后调用 ConnectionPool::warmUp()
+ * 在自己的线程里预热连接，所以需要预热时在启动阶段调用 start()，并且工作线程数不少于 min_idle；
+ * 同步访问数据库的请求线程也可以自己安排预热，参考 ConnectionPool。工作线程没有事件循环，空闲时每隔 maintenance_interval 毫秒
+ * 调用 ConnectionPool::serviceConnections()，关闭连接池标记关闭的本线程的连接、验证 test_while_idle 标记的连接。
+ *
+ * 任务队列有最大长度（database.async_queue_capacity），队列满时提交任务的线程最多等待
+ * database.async_submit_timeout 毫秒，仍然满则拒绝，避免任务无限堆积，调用者据此降低提交速度。
+ *
+ * 程序结束前需要在关闭连接池之前调用 Singleton<DbExecutor>::getInstance().release()，
+ * 等待已提交的任务执行完并停止工作线程。
+ */
+class DbExecutor
+{
+    SINGLETON(DbExecutor)
+
+public:
+    // 启动工作线程，已经启动或者已经停止时什么都不做
+    void start();
+    // 提交任务，被拒绝（队列满或者已经停止）时返回 false。任务抛出的异常只记录日志，需要通知调用者时在任务里自己处理
+    bool submit(const std::function<void()> &task);
+    // 队列中等待执行的任务数
+    int pendingCount() const;
+    // 执行完已提交的任务后停止所有工作线程
+    void release();
+
+private:
+    class Private;
+    friend class Private;
+    Private *d;
+};
+
+#endif // DBEXECUTOR_H
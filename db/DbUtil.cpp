@@ -1,14 +1,30 @@
 #include "DbUtil.h"
 #include "db/ConnectionPool.h"
+#include "db/DataSourceManager.h"
+#include "db/StatementCache.h"
+#include "db/Transaction.h"
+#include "db/QueryCache.h"
+#include "db/SlowQueryLog.h"
+#include "db/StatementStats.h"
+#include "db/SqlUtil.h"
 #include "util/Config.h"
 
+#include <QScopedPointer>
+#include <QSqlDriver>
+#include <QDataStream>
+#include <QElapsedTimer>
+
+// selectPage 的 SQL 中表示翻页条件的标记
+static const QString KEYSET_TOKEN = "{keyset}";
+
 int DbUtil::insert(const QString &sql, const QVariantMap &params)
 {
     int id = -1;
     //id 是引用传递
-    executeSql(sql, params, [&id](QSqlQuery *query){
+    executeSql(sql, params, DataSourceManager::WriteAccess, [&id](QSqlQuery *query){
         //插入行的主键
         id = query->lastInsertId().toInt();
+        return 0;
     });
     return id;
 }
@@ -16,24 +32,231 @@ int DbUtil::insert(const QString &sql, const QVariantMap &params)
 bool DbUtil::update(const QString &sql, const QVariantMap &params)
 {
     bool result;
-    executeSql(sql, params, [&result](QSqlQuery *query){
+    executeSql(sql, params, DataSourceManager::WriteAccess, [&result](QSqlQuery *query){
         result = query->lastError().type() == QSqlError::NoError;
+        return 0;
     });
     return result;
 }
 
+QList<int> DbUtil::insertBatch(const QString &sql, const QList<QVariantMap> &rows)
+{
+    return executeBatch(sql, rowsToColumns(rows), true);
+}
+
+QList<int> DbUtil::insertBatch(const QString &sql, const QVariantMap &columns)
+{
+    return executeBatch(sql, columns, true);
+}
+
+QList<int> DbUtil::updateBatch(const QString &sql, const QList<QVariantMap> &rows)
+{
+    return executeBatch(sql, rowsToColumns(rows), false);
+}
+
+QList<int> DbUtil::updateBatch(const QString &sql, const QVariantMap &columns)
+{
+    return executeBatch(sql, columns, false);
+}
+
+int DbUtil::bulkWrite(const BulkWriter &writer)
+{
+    if (writer.rowCount() == 0) {
+        return 0;
+    }
+
+    // 所有语句使用同一个连接，在一个事务里执行
+    Transaction transaction;
+    if (!transaction.isActive()) {
+        return -1;
+    }
+
+    Config &config = Singleton<Config>::getInstance();
+    QList<BulkWriter::Statement> statements = writer.statements(transaction.database().driverName(),
+                                                                config.getDatabaseBulkMaxParameters(),
+                                                                config.getDatabaseBulkMaxBytes());
+    if (statements.isEmpty()) {
+        transaction.rollback();
+        return -1;
+    }
+
+    int affected = 0;
+    for (const BulkWriter::Statement &statement : statements) {
+        int count = -1;
+        executeSql(statement.sql, statement.params, DataSourceManager::WriteAccess, [&count](QSqlQuery *query){
+            count = query->numRowsAffected();
+            return 0;
+        });
+        if (count < 0) {
+            transaction.rollback();
+            return -1;
+        }
+        affected += count;
+    }
+    return transaction.commit() ? affected : -1;
+}
+
+bool DbUtil::transaction(std::function<bool (Transaction &)> work)
+{
+    Transaction transaction;
+    if (!transaction.isActive()) {
+        return false;
+    }
+    if (!work(transaction)) {
+        transaction.rollback();
+        return false;
+    }
+    return transaction.commit();
+}
+
 QVariantMap DbUtil::selectMap(const QString &sql, const QVariantMap &params)
 {
-    return selectMaps(sql, params).value(0);
+    // 只需要第一行，读到后就停止
+    QVariantMap rowMap;
+    forEachRow(sql, params, [&rowMap](const QVariantMap &row) {
+        rowMap = row;
+        return false;
+    });
+    return rowMap;
 }
 
 QList<QVariantMap> DbUtil::selectMaps(const QString &sql, const QVariantMap &params)
 {
-    QList<QVariantMap> rowMaps;
-    executeSql(sql, params, [&rowMaps](QSqlQuery *query){
-        rowMaps = queryToMaps(query);
+    return selectResultSet(sql, params).toMaps();
+}
+
+ResultSet DbUtil::selectResultSet(const QString &sql, const QVariantMap &params)
+{
+    ResultSet rs;
+    if (selectCached(sql, params, &rs)) {
+        return rs;
+    }
+    executeSql(sql, params, DataSourceManager::ReadAccess, [&rs](QSqlQuery *query){
+        rs = ResultSet::fromQuery(query);
+        return rs.rowCount();
     });
-    return rowMaps;
+    return rs;
+}
+
+int DbUtil::forEachRow(const QString &sql, const QVariantMap &params, std::function<bool (const QVariantMap &)> visitor)
+{
+    int count = 0;
+    ResultSet rs;
+    if (selectCached(sql, params, &rs)) {
+        QStringList fieldNames = rs.columnNames();
+        QVariantMap rowMap;
+        for (int row = 0; row < rs.rowCount(); ++row) {
+            for (int i = 0; i < fieldNames.size(); ++i) {
+                rowMap.insert(fieldNames.at(i), rs.value(row, i));
+            }
+            ++count;
+            if (!visitor(rowMap)) {
+                break;
+            }
+        }
+        return count;
+    }
+
+    executeSql(sql, params, DataSourceManager::ReadAccess, [&count, &visitor](QSqlQuery *query){
+        QStringList fieldNames = getFieldNames(*query);
+        int fieldCount = fieldNames.size();
+        // 每行的列名都相同，重用同一个 map 只替换列的值
+        QVariantMap rowMap;
+        while (query->next()) {
+            for (int i = 0; i < fieldCount; ++i) {
+                rowMap.insert(fieldNames.at(i), query->value(i));
+            }
+            ++count;
+            if (!visitor(rowMap)) {
+                break;
+            }
+        }
+        return count;
+    });
+    return count;
+}
+
+int DbUtil::forEachChunk(const QString &sql, const QVariantMap &params,
+                         std::function<bool (const ResultSet &)> visitor, int fetchSize)
+{
+    if (fetchSize <= 0) {
+        fetchSize = qMax(1, Singleton<Config>::getInstance().getDatabaseFetchSize());
+    }
+
+    int count = 0;
+    executeSql(sql, params, DataSourceManager::ReadAccess, [&count, &visitor, fetchSize](QSqlQuery *query){
+        forever {
+            ResultSet chunk = ResultSet::fromQuery(query, fetchSize);
+            if (chunk.isEmpty()) {
+                break;
+            }
+            count += chunk.rowCount();
+            // 不足一块说明已经读完了
+            if (!visitor(chunk) || chunk.rowCount() < fetchSize) {
+                break;
+            }
+        }
+        return count;
+    });
+    return count;
+}
+
+Page DbUtil::selectPage(const QString &sql, const QStringList &keyColumns, const QString &cursor, int pageSize,
+                       const QVariantMap &params, bool descending)
+{
+    Page page;
+    if (!sql.contains(KEYSET_TOKEN) || keyColumns.isEmpty() || pageSize <= 0) {
+        qDebug() << "    => SQL Page Error: needs {keyset} in SQL, key columns and page size" << sql;
+        return page;
+    }
+
+    // 第一页没有条件，之后从上一页最后一行的 key 之后开始
+    QVariantMap pageParams = params;
+    QString predicate = "1=1";
+    if (!cursor.isEmpty()) {
+        QVariantList keys;
+        if (!decodeCursor(cursor, &keys) || keys.size() != keyColumns.size()) {
+            qDebug() << "    => SQL Page Error: invalid cursor" << cursor;
+            return page;
+        }
+        QStringList holders;
+        for (int i = 0; i < keys.size(); ++i) {
+            QString name = "keyset_" + QString::number(i);
+            holders << ":" + name;
+            pageParams.insert(name, keys.at(i));
+        }
+        QString op = descending ? " < " : " > ";
+        predicate = keyColumns.size() == 1
+                ? keyColumns.first() + op + holders.first()
+                : "(" + keyColumns.join(", ") + ")" + op + "(" + holders.join(", ") + ")";
+    }
+    // 多取一行，判断是否还有下一页
+    pageParams.insert("limit", pageSize + 1);
+
+    QString pageSql = sql;
+    pageSql.replace(KEYSET_TOKEN, predicate);
+    executeSql(pageSql, pageParams, DataSourceManager::ReadAccess, [&page, pageSize](QSqlQuery *query){
+        page.rows = ResultSet::fromQuery(query, pageSize);
+        page.hasMore = query->next();
+        return page.rows.rowCount() + (page.hasMore ? 1 : 0);
+    });
+
+    if (page.hasMore) {
+        int lastRow = page.rows.rowCount() - 1;
+        QVariantList keys;
+        for (const QString &keyColumn : keyColumns) {
+            QString name = keyColumn.mid(keyColumn.lastIndexOf('.') + 1);
+            int column = page.rows.columnIndex(name);
+            if (column < 0) {
+                qDebug() << "    => SQL Page Error: key column is not selected" << keyColumn;
+                page.hasMore = false;
+                return page;
+            }
+            keys << page.rows.value(lastRow, column);
+        }
+        page.nextCursor = encodeCursor(keys);
+    }
+    return page;
 }
 
 int DbUtil::selectInt(const QString &sql, const QVariantMap &params)
@@ -54,10 +277,18 @@ QString DbUtil::selectString(const QString &sql, const QVariantMap &params)
 QStringList DbUtil::selectStrings(const QString &sql, const QVariantMap &params)
 {
     QStringList results;
-    executeSql(sql, params, [&results](QSqlQuery *query){
+    ResultSet rs;
+    if (selectCached(sql, params, &rs)) {
+        for (int row = 0; row < rs.rowCount(); ++row) {
+            results << rs.getString(row, 0);
+        }
+        return results;
+    }
+    executeSql(sql, params, DataSourceManager::ReadAccess, [&results](QSqlQuery *query){
         while (query->next()) {
             results << query->value(0).toString();
         }
+        return results.size();
     });
     return results;
 }
@@ -75,27 +306,332 @@ QDateTime DbUtil::selectDateTime(const QString &sql, const QVariantMap &params)
 QVariant DbUtil::selectVariant(const QString &sql, const QVariantMap &params)
 {
     QVariant result;
-    executeSql(sql, params, [&result](QSqlQuery *query){
-        if (query->next()) {
-            result = query->value(0);
+    ResultSet rs;
+    if (selectCached(sql, params, &rs)) {
+        return rs.value(0, 0);
+    }
+    executeSql(sql, params, DataSourceManager::ReadAccess, [&result](QSqlQuery *query){
+        if (!query->next()) {
+            return 0;
         }
+        result = query->value(0);
+        return 1;
     });
     return result;
 }
 
-void DbUtil::executeSql(const QString &sql, const QVariantMap &params, std::function<void (QSqlQuery *)> handleResult)
+QFuture<int> DbUtil::insertAsync(const QString &sql, const QVariantMap &params)
 {
-    QSqlDatabase db = Singleton<ConnectionPool>::getInstance().openConnection();
-    QSqlQuery query(db);
-    query.prepare(sql);
-    bindValues(&query, params);
-    
-    if (query.exec()) {
-        handleResult(&query);
+    return async<int>([=]() { return insert(sql, params); });
+}
+
+QFuture<bool> DbUtil::updateAsync(const QString &sql, const QVariantMap &params)
+{
+    return async<bool>([=]() { return update(sql, params); });
+}
+
+QFuture<QVariantMap> DbUtil::selectMapAsync(const QString &sql, const QVariantMap &params)
+{
+    return async<QVariantMap>([=]() { return selectMap(sql, params); });
+}
+
+QFuture<QList<QVariantMap> > DbUtil::selectMapsAsync(const QString &sql, const QVariantMap &params)
+{
+    return async<QList<QVariantMap> >([=]() { return selectMaps(sql, params); });
+}
+
+QFuture<ResultSet> DbUtil::selectResultSetAsync(const QString &sql, const QVariantMap &params)
+{
+    return async<ResultSet>([=]() { return selectResultSet(sql, params); });
+}
+
+QFuture<QVariant> DbUtil::selectVariantAsync(const QString &sql, const QVariantMap &params)
+{
+    return async<QVariant>([=]() { return selectVariant(sql, params); });
+}
+
+void DbUtil::executeSql(const QString &sql, const QVariantMap &params, DataSourceManager::AccessMode mode,
+                        std::function<int (QSqlQuery *)> handleResult)
+{
+    // 当前线程在事务中时使用事务的连接，否则借一个连接：读操作使用读库，写操作使用主库
+    // connection 离开作用域时自动释放回连接池，query 定义在它之后，会先于它析构
+    Transaction *transaction = Transaction::current();
+    PooledConnection connection;
+    if (transaction == NULL) {
+        connection = Singleton<DataSourceManager>::getInstance().poolFor(mode).borrowConnection();
+    }
+    QSqlDatabase db = transaction != NULL ? transaction->database() : connection.database();
+    StatementCache *statements = transaction != NULL ? transaction->statementCache() : connection.statementCache();
+
+    // 启用慢查询日志或者语句统计时分别记录 prepare, exec 和读取结果的耗时
+    SlowQueryLog &slowQueryLog = Singleton<SlowQueryLog>::getInstance();
+    StatementStats &statementStats = Singleton<StatementStats>::getInstance();
+    bool timed = slowQueryLog.isEnabled() || statementStats.isEnabled();
+    SlowQueryLog::Timing timing;
+    QElapsedTimer timer;
+    if (timed) {
+        timer.start();
+    }
+
+    // 优先复用这个连接上已经 prepare 过的语句，只需要重新绑定参数
+    QScopedPointer<QSqlQuery> query(statements != NULL ? statements->take(sql) : NULL);
+    bool prepared = !query.isNull();
+    if (!prepared) {
+        query.reset(new QSqlQuery(db));
+        // DbUtil 只会从前往后读取一次结果，驱动不需要为随机访问缓存结果
+        query->setForwardOnly(true);
+        prepared = query->prepare(sql);
+    }
+    // prepare_ms 只包括取得缓存的语句或者 prepare，绑定参数计入 exec_ms
+    if (timed) {
+        timing.prepareNanos = timer.nsecsElapsed();
+    }
+    // prepare 失败时不执行，lastError() 是 prepare 的错误，下面按执行失败记录
+    if (prepared) {
+        bindValues(query.data(), params);
+    }
+
+    bool executed = prepared && query->exec();
+    if (timed) {
+        timing.execNanos = timer.nsecsElapsed() - timing.prepareNanos;
+    }
+    // 查询的行数由 handleResult 读取时计数，forward-only 的结果读完后驱动已经不知道行数了
+    int rows = -1;
+    if (executed) {
+        rows = handleResult(query.data());
+        if (!query->isSelect()) {
+            rows = query->numRowsAffected();
+        }
+    }
+    if (timed) {
+        timing.fetchNanos = timer.nsecsElapsed() - timing.prepareNanos - timing.execNanos;
+        statementStats.record(sql, timing.totalNanos() / 1000, rows, !executed);
+        if (slowQueryLog.isSlow(timing)) {
+            slowQueryLog.log(Singleton<SqlUtil>::getInstance().getStatementId(sql), sql, params, timing,
+                             rows, query->lastError().text().trimmed());
+        }
     }
     
-    debug(query, params);
-    Singleton<ConnectionPool>::getInstance().closeConnection(db);
+    debug(*query, params);
+
+    // 执行成功的语句放回缓存，下次执行相同的 SQL 时复用；prepare 或者执行失败时可能是连接断开或者语句在服务端失效了，
+    // 删除它，下次重新 prepare
+    if (statements != NULL && executed) {
+        statements->put(sql, query.take());
+    }
+
+    // 写操作后依赖被修改的表的查询结果缓存失效
+    if (mode == DataSourceManager::WriteAccess) {
+        invalidateCache(sql);
+    }
+}
+
+void DbUtil::invalidateCache(const QString &sql)
+{
+    // 事务提交前其他线程还读不到修改，这时失效的话它们查询到的旧数据会按新的版本号缓存，所以等事务结束时再失效
+    Transaction *transaction = Transaction::current();
+    if (transaction != NULL) {
+        transaction->recordWrite(sql);
+    } else {
+        Singleton<QueryCache>::getInstance().invalidate(sql);
+    }
+}
+
+bool DbUtil::selectCached(const QString &sql, const QVariantMap &params, ResultSet *rs)
+{
+    // 事务里要读到事务中修改的数据，不使用缓存
+    if (Transaction::current() != NULL) {
+        return false;
+    }
+
+    QueryCache &cache = Singleton<QueryCache>::getInstance();
+    QueryCache::Ticket ticket;
+    if (cache.lookup(sql, params, rs, &ticket)) {
+        return true;
+    }
+    if (!ticket.cacheable) {
+        return false;
+    }
+
+    bool executed = false;
+    executeSql(sql, params, DataSourceManager::ReadAccess, [rs, &executed](QSqlQuery *query){
+        *rs = ResultSet::fromQuery(query);
+        executed = true;
+        return rs->rowCount();
+    });
+    // 出错时不缓存
+    if (executed) {
+        cache.store(ticket, *rs);
+    }
+    return true;
+}
+
+QList<int> DbUtil::executeBatch(const QString &sql, const QVariantMap &columns, bool insert)
+{
+    // 参数名加上 : 后的列，只转换一次
+    QList<QPair<QString, QVariantList> > values;
+    int rowCount = columns.isEmpty() ? 0 : columns.constBegin().value().toList().size();
+    for (QVariantMap::const_iterator i = columns.constBegin(); i != columns.constEnd(); ++i) {
+        QVariantList column = i.value().toList();
+        if (column.size() != rowCount) {
+            qDebug() << "    => SQL Batch Error: columns have different row counts" << sql;
+            return QList<int>();
+        }
+        values.append(qMakePair(":" + i.key(), column));
+    }
+    if (rowCount == 0) {
+        return QList<int>();
+    }
+
+    // 所有行在一个事务里执行，已经在事务中时是一个保存点，失败时只撤销这个批次
+    Transaction transaction;
+    QSqlDatabase db = transaction.database();
+    StatementCache *statements = transaction.statementCache();
+
+    // 和 executeSql 一样记录统计和慢查询日志，整个批次记录为一次执行，fetch 为 0
+    SlowQueryLog &slowQueryLog = Singleton<SlowQueryLog>::getInstance();
+    StatementStats &statementStats = Singleton<StatementStats>::getInstance();
+    bool timed = slowQueryLog.isEnabled() || statementStats.isEnabled();
+    SlowQueryLog::Timing timing;
+    QElapsedTimer timer;
+    if (timed) {
+        timer.start();
+    }
+
+    QScopedPointer<QSqlQuery> query;
+    bool prepared = false;
+    if (transaction.isActive()) {
+        query.reset(statements != NULL ? statements->take(sql) : NULL);
+        prepared = !query.isNull();
+        if (!prepared) {
+            query.reset(new QSqlQuery(db));
+            query->setForwardOnly(true);
+            prepared = query->prepare(sql);
+        }
+    }
+    if (timed) {
+        timing.prepareNanos = timer.nsecsElapsed();
+    }
+
+    QList<int> results;
+    results.reserve(rowCount);
+    bool ok = prepared;
+    // 所有执行影响的行数之和，有一次驱动不知道时为 -1
+    int affected = 0;
+
+    if (ok && db.driver()->hasFeature(QSqlDriver::BatchOperations)) {
+        // 原生的批量操作，每 batchSize 行绑定为数组执行一次，不能得到每一行的结果
+        int batchSize = qMax(1, Singleton<Config>::getInstance().getDatabaseBatchSize());
+        for (int start = 0; ok && start < rowCount; start += batchSize) {
+            int count = qMin(batchSize, rowCount - start);
+            for (const QPair<QString, QVariantList> &column : values) {
+                query->bindValue(column.first, column.second.mid(start, count));
+            }
+            ok = query->execBatch();
+            int rows = ok ? query->numRowsAffected() : -1;
+            affected = affected < 0 || rows < 0 ? -1 : affected + rows;
+            for (int i = 0; ok && i < count; ++i) {
+                results << -1;
+            }
+        }
+    } else if (ok) {
+        // 驱动不支持批量操作时 execBatch 也是逐行执行，这里自己执行以便得到每一行的结果
+        for (int row = 0; ok && row < rowCount; ++row) {
+            for (const QPair<QString, QVariantList> &column : values) {
+                query->bindValue(column.first, column.second.at(row));
+            }
+            ok = query->exec();
+            int rows = ok ? query->numRowsAffected() : -1;
+            affected = affected < 0 || rows < 0 ? -1 : affected + rows;
+            if (ok && insert) {
+                QVariant id = query->lastInsertId();
+                results << (id.isValid() ? id.toInt() : -1);
+            } else if (ok) {
+                results << rows;
+            }
+        }
+    }
+
+    QString error;
+    if (!query.isNull()) {
+        if (!ok) {
+            error = query->lastError().text().trimmed();
+            qDebug() << "    => SQL Batch Error:" << error;
+        }
+        debug(*query, QVariantMap());
+    }
+
+    // 结束事务后连接会归还给连接池，语句要在这之前放回缓存，执行失败的语句不再复用
+    if (statements != NULL && ok) {
+        statements->put(sql, query.take());
+    }
+    query.reset();
+
+    if (ok) {
+        ok = transaction.commit();
+    } else if (transaction.isActive()) {
+        transaction.rollback();
+    }
+    if (!ok) {
+        results.clear();
+        if (error.isEmpty()) {
+            // 开始或者提交事务失败
+            error = db.lastError().text().trimmed();
+        }
+    }
+    if (timed) {
+        // 提交事务的时间计入 exec
+        timing.execNanos = timer.nsecsElapsed() - timing.prepareNanos;
+        int rows = ok ? affected : -1;
+        statementStats.record(sql, timing.totalNanos() / 1000, rows, !ok);
+        if (slowQueryLog.isSlow(timing)) {
+            slowQueryLog.log(Singleton<SqlUtil>::getInstance().getStatementId(sql), sql, columns, timing, rows, error);
+        }
+    }
+    // 批次的事务已经结束，外层还有事务时由外层事务结束时失效
+    invalidateCache(sql);
+    return results;
+}
+
+QVariantMap DbUtil::rowsToColumns(const QList<QVariantMap> &rows)
+{
+    // 所有行中出现过的参数名
+    QStringList names;
+    for (const QVariantMap &row : rows) {
+        for (QVariantMap::const_iterator i = row.constBegin(); i != row.constEnd(); ++i) {
+            if (!names.contains(i.key())) {
+                names << i.key();
+            }
+        }
+    }
+
+    QVariantMap columns;
+    for (const QString &name : names) {
+        QVariantList column;
+        column.reserve(rows.size());
+        for (const QVariantMap &row : rows) {
+            column << row.value(name);
+        }
+        columns.insert(name, column);
+    }
+    return columns;
+}
+
+QString DbUtil::encodeCursor(const QVariantList &keys)
+{
+    // QDataStream 保留值的类型，base64url 可以直接放在 URL 里
+    QByteArray data;
+    QDataStream out(&data, QIODevice::WriteOnly);
+    out << keys;
+    return QString::fromLatin1(data.toBase64(QByteArray::Base64UrlEncoding | QByteArray::OmitTrailingEquals));
+}
+
+bool DbUtil::decodeCursor(const QString &cursor, QVariantList *keys)
+{
+    QByteArray data = QByteArray::fromBase64(cursor.toLatin1(), QByteArray::Base64UrlEncoding | QByteArray::OmitTrailingEquals);
+    QDataStream in(data);
+    in >> *keys;
+    return in.status() == QDataStream::Ok && in.atEnd() && !keys->isEmpty();
 }
 
 QStringList DbUtil::getFieldNames(const QSqlQuery &query)
@@ -115,20 +651,6 @@ void DbUtil::bindValues(QSqlQuery *query, const QVariantMap &params)
     }
 }
 
-QList<QVariantMap> DbUtil::queryToMaps(QSqlQuery *query)
-{
-    QList<QVariantMap> rowMaps;
-    QStringList fieldNames = getFieldNames(*query);
-    while (query->next()) {
-        QVariantMap rowMap;
-        for (const QString fieldName : fieldNames) {
-            rowMap.insert(fieldName, query->value(fieldName));
-        }
-        rowMaps.append(rowMap);
-    }
-    return rowMaps;
-}
-
 void DbUtil::debug(const QSqlQuery &query, const QVariantMap &params)
 {
     if (Singleton<Config>::getInstance().isDatabaseDebug()) {
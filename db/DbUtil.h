@@ -8,6 +8,32 @@
 #include <QSqlRecord>
 #include <QSqlError>
 #include <QDebug>
+#include <QFuture>
+#include <QFutureInterface>
+
+#include <functional>
+
+#include "db/DataSourceManager.h"
+#include "db/DbExecutor.h"
+#include "db/BeanMapper.h"
+#include "db/BulkWriter.h"
+#include "db/Transaction.h"
+#include "db/ResultSet.h"
+
+/**
+ * DbUtil::selectPage() 返回的一页数据.
+ */
+struct Page {
+    // 这一页的记录
+    ResultSet rows;
+    // 取得下一页时传入的游标，没有下一页时为空
+    QString nextCursor;
+    // 是否还有下一页
+    bool hasMore;
+
+    Page() : hasMore(false) {}
+};
+
 /**
  * 本类封装了一些操作数据库的通用方法，例如插入、更新操作、查询结果返回整数，时间类型，
  * 还可以把查询结果映射成 map，甚至通过传入的映射函数把 map 映射成对象等，也就是 Bean，
@@ -27,12 +53,68 @@
  * 比较常用的方法有:
  *     insert
  *     update: 包括更新和删除
+ *     insertBatch
+ *     updateBatch
+ *     bulkWrite
  *
  *     selectMap
  *     selectMaps
+ *     selectResultSet
  *     selectBean
  *     selectBeans
  *     selectStrings
+ *     forEachRow
+ *     forEachChunk
+ *     selectPage
+ *
+ * 分页: selectPage 使用 keyset 分页，不使用 LIMIT/OFFSET，无论第几页都只需要从索引中定位到上一页的最后一行。
+ * SQL 里用 {keyset} 表示翻页的条件，用 :limit 表示每页的行数，ORDER BY 必须和 keyColumns 一致，如
+ *      SELECT id, username FROM user WHERE {keyset} ORDER BY id LIMIT :limit
+ * 第一页 {keyset} 替换为 1=1，之后替换为 id > :keyset_0 (多列时为 (a, b) > (:keyset_0, :keyset_1))，
+ * 上一页最后一行的 keyColumns 的值编码在返回的游标里，调用者原样传回即可，例如
+ *      QString cursor;
+ *      do {
+ *          Page page = DbUtil::selectPage(sql, QStringList() << "id", cursor, 100);
+ *          ...
+ *          cursor = page.nextCursor;
+ *      } while (!cursor.isEmpty());
+ *
+ * 映射 bean: selectBean/selectBeans/forEachBean 可以传入把 map 映射成对象的函数，也可以传入 BeanMapper，
+ * 后者按列的下标直接调用 bean 的 setter，不需要为每一行创建 map，结果很多时快很多。
+ *
+ * 流式查询: forEachRow 和 forEachBean 每取得一行就交给回调函数处理，不会把所有行保存到 list 里，
+ * 回调函数返回 false 时停止读取后面的行，适合导出等结果很大的查询。forEachChunk 每次读取 fetchSize 行
+ * （默认为 database.fetch_size）作为一个 ResultSet 交给回调函数，内存中最多只有一块。
+ * 所有的查询都使用只向前的游标 (QSqlQuery::setForwardOnly)，驱动不需要为了随机访问缓存结果；
+ * 驱动自己的预取行数等可以在 database.connect_options 中配置。
+ * 注意 QMYSQL 不受只向前的影响：无论是否 prepare，exec() 都用 mysql_store_result/mysql_stmt_store_result
+ * 把整个结果读到客户端，Qt 也没有提供逐行读取 (mysql_use_result) 的连接选项。所以在 MySQL 上 forEachChunk
+ * 只限制转换成 QVariant 的行数，驱动里仍然有完整的结果；结果很大时用 selectPage 按 keyset 分页读取。
+ *
+ * 批量执行: insertBatch 和 updateBatch 一次执行多行参数，只取得一次连接，所有行在同一个事务里执行，
+ * 任何一行失败时整个批次回滚。驱动支持批量操作时（QSqlDriver::BatchOperations）参数按列绑定为
+ * QVariantList，每 database.batch_size 行调用一次 execBatch，否则使用同一个 prepare 过的语句逐行执行。
+ *
+ * 事务: DbUtil::transaction() 或者在作用域内定义 Transaction，当前线程的所有 DbUtil 操作都使用事务的连接，
+ * 参考 Transaction.h，例如
+ *      DbUtil::transaction([&](Transaction &) {
+ *          return DbUtil::update(sql1, params1) && DbUtil::update(sql2, params2);
+ *      });
+ *
+ * 多行插入: bulkWrite 执行 BulkWriter 构造的多行 INSERT 语句，一条语句插入很多行，还可以冲突时更新或者忽略，
+ * 参考 BulkWriter.h。
+ *
+ * 结果缓存: 在 SQL 文件里给 <sql> 加上 cache="true" 和 tables 属性后，select* 和 forEachRow/forEachBean 的结果
+ * 缓存在 QueryCache 里，写操作后依赖被修改的表的缓存自动失效，参考 QueryCache.h。forEachChunk 不使用缓存。
+ *
+ * 读写分离: insert 和 update 使用主库，select* 使用读库（参考 DataSourceManager），
+ * 需要读取刚写入的数据时，在作用域内定义 PrimaryReadScope 让当前线程读主库。
+ *
+ * 异步执行: *Async 函数在 DbExecutor 的工作线程里执行，立即返回 QFuture，不阻塞调用者，例如
+ *      QFuture<bool> future = DbUtil::updateAsync(sql, params);
+ * 在事件循环的线程里可以用 QFutureWatcher 得到完成的通知；也可以用 async() 传入 continuation，
+ * 在工作线程里得到结果后马上执行。任务队列满被拒绝或者任务抛出异常时返回的 QFuture 处于 canceled 状态。
+ * 注意 PrimaryReadScope 只对当前线程有效，不会传递到工作线程。
  */
 class DbUtil
 {
@@ -51,6 +133,37 @@ public:
      * @return 如没有错误返回 true， 有错误返回 false.
      */
     static bool update(const QString &sql, const QVariantMap &params = QVariantMap());
+    /**
+     * @brief 批量执行插入语句，所有行在同一个事务里执行.
+     * @param sql sql语句
+     * @param rows 每一行的参数
+     * @return 执行成功返回每一行插入的记录的 id，驱动不能返回 id 时（例如原生的批量操作）为 -1；
+     *         有错误时回滚并返回空的 list.
+     */
+    static QList<int> insertBatch(const QString &sql, const QList<QVariantMap> &rows);
+    /**
+     * @brief 批量执行插入语句，参数按列传入，key 是参数名，value 是这一列所有行的值 (QVariantList)，
+     *        每一列的行数必须相同.
+     */
+    static QList<int> insertBatch(const QString &sql, const QVariantMap &columns);
+    /**
+     * @brief 批量执行更新语句 (update 和 delete 语句都是更新语句)，所有行在同一个事务里执行.
+     * @param sql sql语句
+     * @param rows 每一行的参数
+     * @return 执行成功返回每一行影响的记录数，驱动不能返回时（例如原生的批量操作）为 -1；
+     *         有错误时回滚并返回空的 list.
+     */
+    static QList<int> updateBatch(const QString &sql, const QList<QVariantMap> &rows);
+    /**
+     * @brief 批量执行更新语句，参数按列传入，同 insertBatch.
+     */
+    static QList<int> updateBatch(const QString &sql, const QVariantMap &columns);
+    /**
+     * @brief 执行 writer 的多行 INSERT 语句，所有语句在同一个事务里执行.
+     * @param writer 添加了所有行的 BulkWriter
+     * @return 执行成功返回驱动报告的影响的记录数之和 (MySQL 的 upsert 更新的行算 2)，有错误时回滚并返回 -1.
+     */
+    static int bulkWrite(const BulkWriter &writer);
     /**
      * @brief 执行查询语句，查询到多条记录，并把每一条记录其映射成一个 map，Key 是列名，Value 是列值.
      * @param sql sql语句
@@ -66,6 +179,60 @@ public:
      * @return 返回记录映射的 map 的 list.
      */
     static QList<QVariantMap> selectMaps(const QString &sql, const QVariantMap &params = QVariantMap());
+    /**
+     * @brief 执行查询语句，返回紧凑的 ResultSet，列名只解析一次，按下标访问列的值，
+     *        结果很多时比 selectMaps 节省内存和时间.
+     * @param sql sql语句
+     * @param params 参数
+     * @return 查询的结果，有错误时返回空的 ResultSet.
+     */
+    static ResultSet selectResultSet(const QString &sql, const QVariantMap &params = QVariantMap());
+    /**
+     * @brief 执行查询语句，每取得一条记录就映射成 map 传给 visitor，不保存所有的记录.
+     *        为了避免每行分配内存，传给 visitor 的 map 在读取下一行时会被重用，需要保存时请复制.
+     * @param sql sql语句
+     * @param params 参数
+     * @param visitor 处理一行的函数，返回 false 时不再读取后面的记录
+     * @return 处理了的记录数
+     */
+    static int forEachRow(const QString &sql, const QVariantMap &params,
+                          std::function<bool(const QVariantMap &row)> visitor);
+    /**
+     * @brief 执行查询语句，每次读取 fetchSize 行作为一个 ResultSet 传给 visitor，不保存所有的记录.
+     *        QMYSQL 驱动总是在客户端缓存整个结果，见上面的说明.
+     * @param sql sql语句
+     * @param params 参数
+     * @param visitor 处理一块记录的函数，返回 false 时不再读取后面的记录
+     * @param fetchSize 每块的行数，小于等于 0 时使用 database.fetch_size
+     * @return 处理了的记录数
+     */
+    static int forEachChunk(const QString &sql, const QVariantMap &params,
+                            std::function<bool(const ResultSet &chunk)> visitor, int fetchSize = 0);
+    /**
+     * @brief 使用 keyset 分页查询一页，sql 里用 {keyset} 表示翻页的条件，用 :limit 表示每页的行数.
+     * @param sql sql语句
+     * @param keyColumns 排序的唯一键的列，可以带表名 (如 u.id)，结果中的列名为最后一个 . 之后的部分
+     * @param cursor 上一页返回的 nextCursor，第一页为空
+     * @param pageSize 每页的行数
+     * @param params 参数
+     * @param descending ORDER BY 为降序时为 true
+     * @return 一页数据，有错误时返回空的 Page
+     */
+    static Page selectPage(const QString &sql, const QStringList &keyColumns, const QString &cursor, int pageSize,
+                           const QVariantMap &params = QVariantMap(), bool descending = false);
+    /**
+     * @brief 把最后一行的 key 的值编码为分页的游标，已知 key 时也可以自己构造游标从它之后开始查询.
+     * @param keys key 的值
+     * @return 可以放在 URL 里的字符串
+     */
+    static QString encodeCursor(const QVariantList &keys);
+    /**
+     * @brief 解码分页的游标.
+     * @param cursor encodeCursor 的结果
+     * @param keys 解码得到的 key 的值
+     * @return 游标有效时返回 true
+     */
+    static bool decodeCursor(const QString &cursor, QVariantList *keys);
     /**
      * @brief 查询结果是一个整数值，如查询记录的个数，和等.
      * @param sql sql语句
@@ -136,20 +303,205 @@ public:
      */
     template <typename T>
     static QList<T> selectBeans(T mapToBean(const QVariantMap &rowMap), const QString &sql, const QVariantMap &params = QVariantMap()) {
+        // 每取得一行就映射成 bean，不先保存所有行的 map
         QList<T> beans;
-        for(const QVariantMap row : selectMaps(sql, params)) {
+        forEachRow(sql, params, [&beans, mapToBean](const QVariantMap &row) {
             beans.append(mapToBean(row));
-        }
+            return true;
+        });
+        return beans;
+    }
+    /**
+     * @brief 执行查询语句，每取得一条记录就映射成 bean 传给 visitor，不保存所有的 bean.
+     * @param mapToBean mapToBean - 把 map 映射成对象的函数.
+     * @param visitor 处理一个 bean 的函数，参数为 const T&，返回 false 时不再读取后面的记录
+     * @param sql sql语句
+     * @param params 参数
+     * @return 处理了的记录数
+     */
+    template <typename T, typename Visitor>
+    static int forEachBean(T mapToBean(const QVariantMap &rowMap), Visitor visitor, const QString &sql, const QVariantMap &params = QVariantMap()) {
+        return forEachRow(sql, params, [&visitor, mapToBean](const QVariantMap &row) {
+            return static_cast<bool>(visitor(mapToBean(row)));
+        });
+    }
+    /**
+     * @brief 查询结果封装成一个对象 bean，列直接映射到 bean 的 setter.
+     * @param mapper 声明了列和 setter 的映射
+     * @param sql sql语句
+     * @param params 参数
+     * @return 返回查找到的 bean, 如果没有查找到，返回 T 的默认对象。
+     */
+    template <typename T>
+    static T selectBean(const BeanMapper<T> &mapper, const QString &sql, const QVariantMap &params = QVariantMap()) {
+        T result;
+        forEachBean(mapper, [&result](const T &bean) {
+            result = bean;
+            return false;
+        }, sql, params);
+        return result;
+    }
+    /**
+     * @brief 执行查询语句，查询到多个结果，列直接映射到 bean 的 setter.
+     * @param mapper 声明了列和 setter 的映射
+     * @param sql sql语句
+     * @param params 参数
+     * @return 返回 bean 的 list，如果没有查找到，返回空的 list。
+     */
+    template <typename T>
+    static QList<T> selectBeans(const BeanMapper<T> &mapper, const QString &sql, const QVariantMap &params = QVariantMap()) {
+        QList<T> beans;
+        forEachBean(mapper, [&beans](const T &bean) {
+            beans.append(bean);
+            return true;
+        }, sql, params);
         return beans;
     }
+    /**
+     * @brief 执行查询语句，每取得一条记录就直接映射成 bean 传给 visitor.
+     * @param mapper 声明了列和 setter 的映射
+     * @param visitor 处理一个 bean 的函数，参数为 const T&，返回 false 时不再读取后面的记录
+     * @param sql sql语句
+     * @param params 参数
+     * @return 处理了的记录数
+     */
+    template <typename T, typename Visitor>
+    static int forEachBean(const BeanMapper<T> &mapper, Visitor visitor, const QString &sql, const QVariantMap &params = QVariantMap()) {
+        int count = 0;
+        ResultSet rs;
+        if (selectCached(sql, params, &rs)) {
+            QVector<int> columns = mapper.resolve(rs);
+            for (int row = 0; row < rs.rowCount(); ++row) {
+                T bean;
+                mapper.map(rs, row, columns, &bean);
+                ++count;
+                if (!visitor(bean)) {
+                    break;
+                }
+            }
+            return count;
+        }
+
+        executeSql(sql, params, DataSourceManager::ReadAccess, [&count, &mapper, &visitor](QSqlQuery *query) {
+            // 列的下标每次查询只解析一次
+            QVector<int> columns = mapper.resolve(query->record());
+            while (query->next()) {
+                T bean;
+                mapper.map(*query, columns, &bean);
+                ++count;
+                if (!visitor(bean)) {
+                    break;
+                }
+            }
+            return count;
+        });
+        return count;
+    }
+    /**
+     * @brief 在一个事务里执行 work，work 里当前线程的所有 DbUtil 操作都使用同一个连接.
+     *        已经在事务中时嵌套为一个保存点。不要在 work 里调用 commit() 或 rollback().
+     * @param work 要执行的函数，返回 true 时提交，返回 false 时回滚
+     * @return 提交成功返回 true，回滚或者开始事务失败返回 false
+     */
+    static bool transaction(std::function<bool(Transaction &transaction)> work);
+    /**
+     * @brief 在 DbExecutor 的工作线程里执行 task，可以在 task 里调用多个 DbUtil 的函数.
+     * @param task 要执行的任务，返回值作为 QFuture 的结果
+     * @param continuation 得到结果后在工作线程里执行，可以为空
+     * @return 任务的 QFuture，任务被拒绝或者 task 抛出异常时处于 canceled 状态
+     */
+    template <typename T>
+    static QFuture<T> async(std::function<T()> task,
+                            std::function<void(const T &result)> continuation = std::function<void(const T &)>()) {
+        QFutureInterface<T> promise;
+        promise.reportStarted();
+        QFuture<T> future = promise.future();
+
+        bool accepted = Singleton<DbExecutor>::getInstance().submit([promise, task, continuation]() mutable {
+            T result;
+            try {
+                result = task();
+            } catch (...) {
+                // 不结束 QFuture 的话等待它的线程会一直阻塞
+                qDebug() << "Async task threw an exception, the future is canceled";
+                promise.reportCanceled();
+                promise.reportFinished();
+                return;
+            }
+            promise.reportResult(result);
+            promise.reportFinished();
+            if (continuation) {
+                continuation(result);
+            }
+        });
+        if (!accepted) {
+            promise.reportCanceled();
+            promise.reportFinished();
+        }
+        return future;
+    }
+    /**
+     * @brief insert 的异步版本.
+     */
+    static QFuture<int> insertAsync(const QString &sql, const QVariantMap &params = QVariantMap());
+    /**
+     * @brief update 的异步版本.
+     */
+    static QFuture<bool> updateAsync(const QString &sql, const QVariantMap &params = QVariantMap());
+    /**
+     * @brief selectMap 的异步版本.
+     */
+    static QFuture<QVariantMap> selectMapAsync(const QString &sql, const QVariantMap &params = QVariantMap());
+    /**
+     * @brief selectMaps 的异步版本.
+     */
+    static QFuture<QList<QVariantMap> > selectMapsAsync(const QString &sql, const QVariantMap &params = QVariantMap());
+    /**
+     * @brief selectResultSet 的异步版本.
+     */
+    static QFuture<ResultSet> selectResultSetAsync(const QString &sql, const QVariantMap &params = QVariantMap());
+    /**
+     * @brief selectVariant 的异步版本.
+     */
+    static QFuture<QVariant> selectVariantAsync(const QString &sql, const QVariantMap &params = QVariantMap());
+    /**
+     * @brief selectBean 的异步版本.
+     */
+    template <typename T>
+    static QFuture<T> selectBeanAsync(T mapToBean(const QVariantMap &rowMap), const QString &sql, const QVariantMap &params = QVariantMap()) {
+        return async<T>([=]() { return selectBean(mapToBean, sql, params); });
+    }
+    /**
+     * @brief selectBeans 的异步版本.
+     */
+    template <typename T>
+    static QFuture<QList<T> > selectBeansAsync(T mapToBean(const QVariantMap &rowMap), const QString &sql, const QVariantMap &params = QVariantMap()) {
+        return async<QList<T> >([=]() { return selectBeans(mapToBean, sql, params); });
+    }
 private:
     /**
      * @brief 定义了访问数据库算法的骨架，SQL 语句执行的结果使用传进来的 Lambda 表达式处理
      * @param sql sql语句
      * @param params 参数
-     * @param fn 处理 SQL 语句执行的结果的 Lambda 表达式
+     * @param mode 读操作还是写操作，决定使用读库还是主库
+     * @param handleResult 处理 SQL 语句执行的结果的 Lambda 表达式，返回读取的行数，用于日志和统计；
+     *        写语句的返回值不使用，影响的行数取自 numRowsAffected()
+     */
+    static void executeSql(const QString &sql, const QVariantMap &params, DataSourceManager::AccessMode mode,
+                           std::function<int(QSqlQuery *query)> handleResult);
+    /**
+     * @brief sql 的结果可以缓存时，从 QueryCache 取得结果，没有缓存时查询并放入缓存.
+     * @param sql sql语句
+     * @param params 参数
+     * @param rs 查询的结果
+     * @return 可以缓存时返回 true，rs 为结果；不能缓存时返回 false，调用者直接查询
+     */
+    static bool selectCached(const QString &sql, const QVariantMap &params, ResultSet *rs);
+    /**
+     * @brief 写语句执行后使依赖被修改的表的查询结果缓存失效，在事务中时等事务结束后再失效.
+     * @param sql 写语句
      */
-    static void executeSql(const QString &sql, const QVariantMap &params, std::function<void(QSqlQuery *query)> handleResult);
+    static void invalidateCache(const QString &sql);
     /**
      * @brief 取得 query 的 labels(没用别名就是数据库里的列名).
      * @param query 查询对象
@@ -163,11 +515,19 @@ private:
      */
     static void bindValues(QSqlQuery *query, const QVariantMap &params);
     /**
-     * @brief 把 query 中的查询得到的所有行映射为 map 的 list.
-     * @param query 查询对象
-     * @return 返回 key 为列名，value为列的值的 map 的 list.
+     * @brief 在一个事务里批量执行 sql，insertBatch 和 updateBatch 的实现.
+     * @param sql sql语句
+     * @param columns 按列的参数，每一列都是 QVariantList
+     * @param insert 为 true 时返回插入行的 id，否则返回影响的记录数
+     * @return 每一行的结果，有错误时返回空的 list
+     */
+    static QList<int> executeBatch(const QString &sql, const QVariantMap &columns, bool insert);
+    /**
+     * @brief 把按行的参数转为按列的参数，某一行缺少的参数绑定为 NULL.
+     * @param rows 每一行的参数
+     * @return key 为参数名，value 为这一列所有行的值的 map
      */
-    static QList<QVariantMap> queryToMaps(QSqlQuery *query);
+    static QVariantMap rowsToColumns(const QList<QVariantMap> &rows);
     /**
      * @brief 如果 app.ini 里 output_sql 为 true，则输出执行的 SQL，如果为 false，则不输出
      * @param query 查询对象
@@ -0,0 +1,115 @@
+#include "LatencyHistogram.h"
+
+// 耗时所在桶的下标，即 micros 的二进制位数
+static int bucketIndex(qint64 micros)
+{
+    int index = 0;
+    for (quint64 value = static_cast<quint64>(micros); value != 0; value >>= 1) {
+        ++index;
+    }
+    return qMin(index, static_cast<int>(LatencyHistogram::BucketCount) - 1);
+}
+
+qint64 LatencyHistogram::Snapshot::mean() const
+{
+    return count > 0 ? sum / count : 0;
+}
+
+qint64 LatencyHistogram::Snapshot::percentile(double p) const
+{
+    if (count == 0) {
+        return 0;
+    }
+
+    qint64 target = qMax(static_cast<qint64>(1), static_cast<qint64>(p * count + 0.5));
+    qint64 seen = 0;
+    for (int i = 0; i < buckets.size(); ++i) {
+        seen += buckets.at(i);
+        if (seen >= target) {
+            // 最大值落在这个桶里时用最大值，比桶的上限更准确
+            return qMin(bucketUpperBound(i), max);
+        }
+    }
+    return max;
+}
+
+void LatencyHistogram::Snapshot::record(qint64 micros)
+{
+    if (micros < 0) {
+        micros = 0;
+    }
+    if (buckets.isEmpty()) {
+        buckets.resize(BucketCount);
+    }
+    ++buckets[bucketIndex(micros)];
+    ++count;
+    sum += micros;
+    max = qMax(max, micros);
+}
+
+void LatencyHistogram::Snapshot::merge(const Snapshot &other)
+{
+    if (other.count == 0) {
+        return;
+    }
+    if (buckets.isEmpty()) {
+        buckets.resize(BucketCount);
+    }
+    for (int i = 0; i < other.buckets.size() && i < buckets.size(); ++i) {
+        buckets[i] += other.buckets.at(i);
+    }
+    count += other.count;
+    sum += other.sum;
+    max = qMax(max, other.max);
+}
+
+LatencyHistogram::LatencyHistogram() : count(0), sum(0), max(0)
+{
+    for (int i = 0; i < BucketCount; ++i) {
+        buckets[i].store(0);
+    }
+}
+
+void LatencyHistogram::record(qint64 micros)
+{
+    if (micros < 0) {
+        micros = 0;
+    }
+
+    buckets[bucketIndex(micros)].fetchAndAddRelaxed(1);
+    count.fetchAndAddRelaxed(1);
+    sum.fetchAndAddRelaxed(micros);
+
+    // 只有超过当前最大值时才需要 CAS
+    qint64 currentMax = max.load();
+    while (micros > currentMax && !max.testAndSetRelaxed(currentMax, micros, currentMax)) {
+    }
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::snapshot() const
+{
+    Snapshot result;
+    result.buckets.resize(BucketCount);
+    for (int i = 0; i < BucketCount; ++i) {
+        result.buckets[i] = buckets[i].load();
+    }
+    result.count = count.load();
+    result.sum = sum.load();
+    result.max = max.load();
+    return result;
+}
+
+void LatencyHistogram::reset()
+{
+    for (int i = 0; i < BucketCount; ++i) {
+        buckets[i].store(0);
+    }
+    count.store(0);
+    sum.store(0);
+    max.store(0);
+}
+
+qint64 LatencyHistogram::bucketUpperBound(int index)
+{
+    return static_cast<qint64>(1) << index;
+}
@@ -0,0 +1,58 @@
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <QAtomicInteger>
+#include <QVector>
+
+/**
+ * 记录耗时分布的直方图，单位是微秒。
+ *
+ * 第 i 个桶记录耗时在 [2^(i-1), 2^i) 微秒之间的次数（第 0 个桶记录 0 微秒），最后一个桶记录所有更大的值。
+ * record() 只使用原子操作，不加锁，可以在多个线程里同时调用，开销很小，适合在生产环境一直开启；
+ * 读取时使用 snapshot() 得到某一时刻的拷贝，各项之间不保证严格一致。
+ */
+class LatencyHistogram
+{
+public:
+    enum { BucketCount = 32 };
+
+    // 某一时刻直方图的拷贝
+    struct Snapshot {
+        QVector<qint64> buckets;
+        qint64 count;
+        qint64 sum;
+        qint64 max;
+
+        Snapshot() : count(0), sum(0), max(0) {}
+        // 平均值
+        qint64 mean() const;
+        // 百分位数（p 在 0 到 1 之间），返回所在桶的上限，精度为 2 倍
+        qint64 percentile(double p) const;
+        // 记录一次耗时，不是原子操作，用于只在一个线程里访问或者加锁访问的直方图
+        void record(qint64 micros);
+        // 加上另一个直方图的记录
+        void merge(const Snapshot &other);
+    };
+
+    LatencyHistogram();
+
+    // 记录一次耗时
+    void record(qint64 micros);
+    // 取得当前的拷贝
+    Snapshot snapshot() const;
+    // 清空所有记录
+    void reset();
+
+    // 第 index 个桶的上限（不包含）
+    static qint64 bucketUpperBound(int index);
+
+private:
+    Q_DISABLE_COPY(LatencyHistogram)
+
+    QAtomicInteger<qint64> buckets[BucketCount];
+    QAtomicInteger<qint64> count;
+    QAtomicInteger<qint64> sum;
+    QAtomicInteger<qint64> max;
+};
+
+#endif // LATENCYHISTOGRAM_H
@@ -0,0 +1,74 @@
+#include "PooledConnection.h"
+#include "db/ConnectionPool.h"
+
+PooledConnection::PooledConnection() : pool(NULL), slotIndex(-1), statements(NULL)
+{
+}
+
+PooledConnection::PooledConnection(ConnectionPool *pool, int slotIndex, const QSqlDatabase &db, StatementCache *statements)
+    : pool(pool), slotIndex(slotIndex), db(db), statements(statements)
+{
+}
+
+PooledConnection::~PooledConnection()
+{
+    release();
+}
+
+PooledConnection::PooledConnection(PooledConnection &&other)
+    : pool(other.pool), slotIndex(other.slotIndex), db(other.db), statements(other.statements)
+{
+    // 所有权转移给新的对象，other 不再释放连接
+    other.pool = NULL;
+    other.slotIndex = -1;
+    other.db = QSqlDatabase();
+    other.statements = NULL;
+}
+
+PooledConnection& PooledConnection::operator=(PooledConnection &&other)
+{
+    if (this != &other) {
+        // 先释放当前持有的连接
+        release();
+        pool = other.pool;
+        slotIndex = other.slotIndex;
+        db = other.db;
+        statements = other.statements;
+
+        other.pool = NULL;
+        other.slotIndex = -1;
+        other.db = QSqlDatabase();
+        other.statements = NULL;
+    }
+    return *this;
+}
+
+bool PooledConnection::isValid() const
+{
+    return pool != NULL;
+}
+
+QSqlDatabase PooledConnection::database() const
+{
+    return db;
+}
+
+StatementCache *PooledConnection::statementCache() const
+{
+    return statements;
+}
+
+void PooledConnection::release()
+{
+    if (pool == NULL) {
+        return;
+    }
+    // 先清空再释放，释放后连接可能马上被其他线程取得
+    ConnectionPool *owner = pool;
+    int index = slotIndex;
+    pool = NULL;
+    slotIndex = -1;
+    db = QSqlDatabase();
+    statements = NULL;
+    owner->returnConnection(index);
+}
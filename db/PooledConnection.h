@@ -0,0 +1,51 @@
+#ifndef POOLEDCONNECTION_H
+#define POOLEDCONNECTION_H
+
+#include <QSqlDatabase>
+
+class ConnectionPool;
+class StatementCache;
+
+/**
+ * 从连接池借出的连接，由 ConnectionPool::borrowConnection() 返回。
+ *
+ * 它记录了连接所在的连接槽的下标，析构时直接按下标释放回连接池，不需要查找。
+ * 只能移动不能复制，所以同一个连接只有一个 PooledConnection 持有，不会被重复释放，
+ * 离开作用域时一定会被释放，不会因为提前 return 或者异常而泄漏。
+ *
+ * 注意: 使用这个连接的 QSqlQuery 必须在 PooledConnection 之前析构（定义在它之后即可），
+ *      否则连接释放后可能已经被其他线程取得，而 QSqlQuery 还在使用它。
+ */
+class PooledConnection
+{
+public:
+    // 无效的连接，例如取得连接超时
+    PooledConnection();
+    ~PooledConnection();
+
+    PooledConnection(PooledConnection &&other);
+    PooledConnection& operator=(PooledConnection &&other);
+
+    // 是否取得了连接
+    bool isValid() const;
+    // 连接，无效时返回无效的 QSqlDatabase
+    QSqlDatabase database() const;
+    // 这个连接上 prepare 过的语句的缓存，没有启用缓存或者连接无效时返回 NULL
+    StatementCache* statementCache() const;
+    // 提前释放回连接池，之后 isValid() 返回 false
+    void release();
+
+private:
+    friend class ConnectionPool;
+    PooledConnection(ConnectionPool *pool, int slotIndex, const QSqlDatabase &db, StatementCache *statements);
+
+    PooledConnection(const PooledConnection &other);
+    PooledConnection& operator=(const PooledConnection &other);
+
+    ConnectionPool *pool;
+    int slotIndex;
+    QSqlDatabase db;
+    StatementCache *statements;
+};
+
+#endif // POOLEDCONNECTION_H
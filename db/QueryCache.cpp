@@ -0,0 +1,403 @@
+#include "QueryCache.h"
+#include "util/Config.h"
+
+#include <QAtomicInteger>
+#include <QCache>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QReadWriteLock>
+#include <QRegularExpression>
+
+// 缓存的结果分散到的分片数，每个分片有自己的锁和 LRU，不同的查询很少竞争同一个锁
+static const int SHARD_COUNT = 16;
+
+/*-----------------------------------------------------------------------------|
+ |                          d指针 的定义                                        |
+ |----------------------------------------------------------------------------*/
+
+// 注册的语句的缓存策略
+struct CachePolicy {
+    bool cache;
+    qint64 ttl;
+    // 查询依赖的表或者写语句修改的表，已经转为小写
+    QStringList tables;
+
+    CachePolicy() : cache(false), ttl(0) {}
+};
+
+// 缓存的一个结果
+struct CacheEntry {
+    ResultSet rs;
+    qint64 expiresAt;
+    // 查询前依赖的表的版本号
+    QVector<quint64> generations;
+};
+
+// 缓存的一个分片，QCache::object() 会调整 LRU 的顺序，查找也要加互斥锁
+struct CacheShard {
+    QMutex mutex;
+    QCache<QString, CacheEntry> entries;
+};
+
+class QueryCache::Private {
+public:
+    qint64 defaultTtl;
+    int maxBytes;
+
+    // 语句的缓存策略，加载 SQL 文件时写入，之后基本只读
+    QReadWriteLock policyLock;
+    QHash<QString, CachePolicy> policies;
+
+    // 按 key 的 hash 分片，每个分片的内存上限是 maxBytes / SHARD_COUNT
+    CacheShard shards[SHARD_COUNT];
+
+    // 以下成员在 generationLock 内访问，查询时只需要读锁，写操作后才需要写锁
+    QReadWriteLock generationLock;
+    // 表的版本号，表被修改时增加
+    QHash<QString, quint64> tableGenerations;
+    // 清空所有缓存时增加
+    quint64 globalGeneration;
+
+    QElapsedTimer clock;
+    QAtomicInteger<qint64> hits;
+    QAtomicInteger<qint64> misses;
+
+    Private();
+
+    CacheShard& shardFor(const QString &key) { return shards[qHash(key) % SHARD_COUNT]; }
+    // 加读锁取得版本号，第一个是 globalGeneration，之后依次是每个表的版本号
+    QVector<quint64> currentGenerations(const QStringList &tables);
+
+    // 缓存的 key，由 SQL 和参数组成，有参数不能序列化时返回 false，这次查询不缓存
+    static bool buildKey(const QString &sql, const QVariantMap &params, QString *key);
+    // 把参数的类型和值追加到 key，不能序列化时返回 false
+    static bool appendValue(QString *key, const QVariant &value);
+    // 常用类型以外的值用 QDataStream 序列化，不能序列化时返回 false
+    static bool writeValue(QDataStream &out, const QVariant &value);
+    // 从 INSERT INTO, REPLACE INTO, UPDATE, DELETE FROM 解析写语句修改的表，多表的写语句解析不可靠，返回空
+    static QStringList writtenTables(const QString &sql);
+    // 去掉表名的引号并转为小写
+    static QString normalizeTable(const QString &table);
+};
+
+QueryCache::Private::Private() : globalGeneration(0)
+{
+    Config &config = Singleton<Config>::getInstance();
+    defaultTtl = config.getDatabaseResultCacheTtl();
+    maxBytes = qMax(0, config.getDatabaseResultCacheMaxBytes());
+    for (CacheShard &shard : shards) {
+        shard.entries.setMaxCost(maxBytes / SHARD_COUNT);
+    }
+    clock.start();
+}
+
+QVector<quint64> QueryCache::Private::currentGenerations(const QStringList &tables)
+{
+    QReadLocker locker(&generationLock);
+    QVector<quint64> generations;
+    generations.reserve(tables.size() + 1);
+    generations << globalGeneration;
+    for (const QString &table : tables) {
+        generations << tableGenerations.value(table, 0);
+    }
+    return generations;
+}
+
+bool QueryCache::Private::buildKey(const QString &sql, const QVariantMap &params, QString *key)
+{
+    // 每个参数写为 名字的长度:名字 和类型、值，值带有长度，拼接后不会有歧义；类型也写入了，1 和 "1" 不会冲突
+    *key = sql;
+    *key += QChar(0x1f);
+    for (QVariantMap::const_iterator i = params.constBegin(); i != params.constEnd(); ++i) {
+        *key += QString::number(i.key().size());
+        *key += ':';
+        *key += i.key();
+        if (!appendValue(key, i.value())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool QueryCache::Private::appendValue(QString *key, const QVariant &value)
+{
+    int type = value.userType();
+    *key += QString::number(type);
+    // 绑定 NULL 的 QString() 等和空的值不同
+    if (value.isNull()) {
+        *key += '~';
+        return true;
+    }
+
+    if (type == QMetaType::QVariantList) {
+        QVariantList list = value.toList();
+        *key += '[' + QString::number(list.size()) + ':';
+        for (const QVariant &item : list) {
+            if (!appendValue(key, item)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    if (type == QMetaType::QVariantMap || type == QMetaType::QVariantHash) {
+        // QVariantHash 的顺序不固定，转为 QVariantMap 按 key 排序
+        QVariantMap map = value.toMap();
+        *key += '{' + QString::number(map.size()) + ':';
+        for (QVariantMap::const_iterator i = map.constBegin(); i != map.constEnd(); ++i) {
+            *key += QString::number(i.key().size()) + ':' + i.key();
+            if (!appendValue(key, i.value())) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // 常用的类型直接转为文本，不经过 QDataStream
+    QString text;
+    switch (type) {
+    case QMetaType::Bool:
+        text = value.toBool() ? "1" : "0";
+        break;
+    case QMetaType::Int:
+    case QMetaType::LongLong:
+        text = QString::number(value.toLongLong());
+        break;
+    case QMetaType::UInt:
+    case QMetaType::ULongLong:
+        text = QString::number(value.toULongLong());
+        break;
+    case QMetaType::Double:
+        text = QString::number(value.toDouble(), 'g', 17);
+        break;
+    case QMetaType::QString:
+        text = value.toString();
+        break;
+    case QMetaType::QByteArray:
+        // Latin1 把每个字节转为一个字符，不会丢失
+        text = QString::fromLatin1(value.toByteArray());
+        break;
+    case QMetaType::QDate:
+        text = value.toDate().toString(Qt::ISODate);
+        break;
+    case QMetaType::QTime:
+        text = value.toTime().toString(Qt::ISODateWithMs);
+        break;
+    case QMetaType::QDateTime:
+        text = value.toDateTime().toString(Qt::ISODateWithMs);
+        break;
+    default: {
+        QByteArray bytes;
+        QDataStream out(&bytes, QIODevice::WriteOnly);
+        out.setVersion(QDataStream::Qt_5_0);
+        if (!writeValue(out, value)) {
+            return false;
+        }
+        text = QString::fromLatin1(bytes);
+        break;
+    }
+    }
+    *key += ':' + QString::number(text.size()) + ':';
+    *key += text;
+    return true;
+}
+
+bool QueryCache::Private::writeValue(QDataStream &out, const QVariant &value)
+{
+    // 自定义的类型和 Gui 模块的类型不一定能序列化 (QVariant 会断言失败)，不缓存
+    if (value.userType() > QMetaType::LastCoreType) {
+        return false;
+    }
+    out << value;
+    return out.status() == QDataStream::Ok;
+}
+
+QStringList QueryCache::Private::writtenTables(const QString &sql)
+{
+    // 表名前可以有 MySQL 的修饰词，例如 UPDATE LOW_PRIORITY user，不能把修饰词当作表名
+    static const QRegularExpression regex("^\\s*(?:INSERT(?:\\s+(?:LOW_PRIORITY|DELAYED|HIGH_PRIORITY|IGNORE))*(?:\\s+INTO)?"
+                                          "|REPLACE(?:\\s+(?:LOW_PRIORITY|DELAYED))*(?:\\s+INTO)?"
+                                          "|UPDATE(?:\\s+(?:LOW_PRIORITY|IGNORE))*"
+                                          "|DELETE(?:\\s+(?:LOW_PRIORITY|QUICK|IGNORE))*\\s+FROM)"
+                                          "\\s+([`\"\\[]?[\\w.]+[`\"\\]]?)",
+                                          QRegularExpression::CaseInsensitiveOption);
+    // 表名（和别名）后面是逗号、JOIN 或者 USING 时修改的不只一个表，例如 UPDATE a JOIN b ... SET，
+    // 只返回第一个表会漏掉其他表的失效，返回空由调用者清空所有缓存
+    static const QRegularExpression multiTable("^\\s*(?:(?:AS\\s+)?\\w+\\s*)?"
+                                               "(?:,|\\b(?:JOIN|STRAIGHT_JOIN|INNER|CROSS|LEFT|RIGHT|NATURAL|USING)\\b)",
+                                               QRegularExpression::CaseInsensitiveOption);
+    QRegularExpressionMatch match = regex.match(sql);
+    if (!match.hasMatch() || multiTable.match(sql.mid(match.capturedEnd(1))).hasMatch()) {
+        return QStringList();
+    }
+    return QStringList(normalizeTable(match.captured(1)));
+}
+
+QString QueryCache::Private::normalizeTable(const QString &table)
+{
+    QString name = table.trimmed().toLower();
+    name.remove('`').remove('"').remove('[').remove(']');
+    return name;
+}
+
+/*-----------------------------------------------------------------------------|
+ |                             QueryCache 的定义                                |
+ |----------------------------------------------------------------------------*/
+
+QueryCache::QueryCache() : d(new QueryCache::Private)
+{
+}
+
+QueryCache::~QueryCache()
+{
+    delete d;
+    d = NULL;
+}
+
+void QueryCache::registerStatement(const QString &sql, bool cache, qint64 ttl, const QStringList &tables)
+{
+    CachePolicy policy;
+    policy.cache = cache;
+    policy.ttl = ttl > 0 ? ttl : d->defaultTtl;
+    for (const QString &table : tables) {
+        if (!table.trimmed().isEmpty()) {
+            policy.tables << Private::normalizeTable(table);
+        }
+    }
+
+    QWriteLocker locker(&d->policyLock);
+    if (policy.tables.isEmpty() && cache) {
+        // 从 SQL 解析依赖的表不可靠（逗号连接、子查询里的表），漏掉的表被修改后会一直返回旧的结果，
+        // 所以缓存的查询必须用 tables 指定依赖的表，没有指定时不缓存
+        qDebug() << "Query result not cached, cache=\"true\" requires tables=\"...\":" << sql;
+        d->policies.remove(sql);
+        return;
+    }
+    d->policies.insert(sql, policy);
+}
+
+void QueryCache::unregisterStatement(const QString &sql)
+{
+    // 缓存的结果找不到策略后不会再被取出，由 QCache 按最久没有使用删除
+    QWriteLocker locker(&d->policyLock);
+    d->policies.remove(sql);
+}
+
+bool QueryCache::lookup(const QString &sql, const QVariantMap &params, ResultSet *rs, Ticket *ticket)
+{
+    ticket->cacheable = false;
+    if (d->maxBytes <= 0) {
+        return false;
+    }
+
+    {
+        QReadLocker locker(&d->policyLock);
+        QHash<QString, CachePolicy>::const_iterator i = d->policies.constFind(sql);
+        if (i == d->policies.constEnd() || !i.value().cache) {
+            return false;
+        }
+        ticket->ttl = i.value().ttl;
+        ticket->tables = i.value().tables;
+    }
+    if (!Private::buildKey(sql, params, &ticket->key)) {
+        qDebug() << "Query result not cached, parameters cannot be serialized:" << sql;
+        return false;
+    }
+    ticket->cacheable = true;
+
+    QVector<quint64> generations = d->currentGenerations(ticket->tables);
+    CacheShard &shard = d->shardFor(ticket->key);
+    QMutexLocker locker(&shard.mutex);
+    CacheEntry *entry = shard.entries.object(ticket->key);
+    if (entry != NULL) {
+        if (entry->expiresAt > d->clock.elapsed() && entry->generations == generations) {
+            *rs = entry->rs;
+            d->hits.fetchAndAddRelaxed(1);
+            return true;
+        }
+        // 过期或者依赖的表被修改了
+        shard.entries.remove(ticket->key);
+    }
+    ticket->generations = generations;
+    d->misses.fetchAndAddRelaxed(1);
+    return false;
+}
+
+void QueryCache::store(const Ticket &ticket, const ResultSet &rs)
+{
+    if (!ticket.cacheable) {
+        return;
+    }
+
+    // 估计内存在锁外进行
+    int cost = qMax(1, rs.memoryCost());
+    CacheEntry *entry = new CacheEntry;
+    entry->rs = rs;
+    entry->generations = ticket.generations;
+
+    // 查询过程中依赖的表被修改了，结果可能已经过期。检查之后到放入之前又被修改时，
+    // 取出时版本号不同也会被丢弃
+    if (d->currentGenerations(ticket.tables) != ticket.generations) {
+        delete entry;
+        return;
+    }
+    entry->expiresAt = d->clock.elapsed() + ticket.ttl;
+    // 超过分片的内存上限时 QCache 删除最久没有使用的结果，单个结果超过上限时直接删除
+    CacheShard &shard = d->shardFor(ticket.key);
+    QMutexLocker locker(&shard.mutex);
+    shard.entries.insert(ticket.key, entry, cost);
+}
+
+void QueryCache::invalidate(const QString &sql)
+{
+    QStringList tables;
+    {
+        QReadLocker locker(&d->policyLock);
+        tables = d->policies.value(sql).tables;
+    }
+    if (tables.isEmpty()) {
+        tables = Private::writtenTables(sql);
+    }
+    if (tables.isEmpty()) {
+        // 不知道修改了哪些表，只能清空所有缓存
+        clear();
+        return;
+    }
+
+    QWriteLocker locker(&d->generationLock);
+    for (const QString &table : tables) {
+        ++d->tableGenerations[table];
+    }
+}
+
+void QueryCache::invalidateTable(const QString &table)
+{
+    QWriteLocker locker(&d->generationLock);
+    ++d->tableGenerations[Private::normalizeTable(table)];
+}
+
+void QueryCache::clear()
+{
+    {
+        QWriteLocker locker(&d->generationLock);
+        ++d->globalGeneration;
+    }
+    // 版本号已经增加，清空分片只是释放内存
+    for (CacheShard &shard : d->shards) {
+        QMutexLocker locker(&shard.mutex);
+        shard.entries.clear();
+    }
+}
+
+qint64 QueryCache::hitCount() const
+{
+    return d->hits.load();
+}
+
+qint64 QueryCache::missCount() const
+{
+    return d->misses.load();
+}
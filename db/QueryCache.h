@@ -0,0 +1,91 @@
+#ifndef QUERYCACHE_H
+#define QUERYCACHE_H
+
+#include "util/Singleton.h"
+#include "db/ResultSet.h"
+
+#include <QString>
+#include <QStringList>
+#include <QVariantMap>
+#include <QVector>
+
+/**
+ * DbUtil 的查询结果缓存，key 是 SQL 语句和绑定的参数，value 是查询得到的 ResultSet。
+ *
+ * 只缓存注册过的语句，一般在 SQL 文件里给 <sql> 加上 cache 属性，SqlUtil 加载时注册:
+ *      <sql id="findAll" cache="true" ttl="60000" tables="user">
+ *          SELECT id, username, password, email, mobile FROM user
+ *      </sql>
+ * ttl 是缓存的毫秒数，没有时使用 database.result_cache_ttl；tables 是查询依赖的表，用逗号分隔，必须列出所有的表
+ * （包括子查询里的表），没有 tables 时不缓存，不从 SQL 解析，避免漏掉的表被修改后一直返回旧的结果。
+ *
+ * DbUtil 执行写操作 (insert, update, 批量操作等) 后调用 invalidate()，从 INSERT INTO, UPDATE, DELETE FROM 等
+ * 解析被修改的表 (写语句的 <sql> 也可以用 tables 属性指定)，依赖这些表的缓存都失效；
+ * 解析不出表或者是多表的 UPDATE、DELETE 时清空所有缓存。
+ * 失效只是增加表的版本号，缓存的结果记录了查询前依赖的表的版本号，取出时版本号不同就丢弃，
+ * 所以查询过程中有写操作时，查询的结果不会被当作新的结果缓存。
+ *
+ * 缓存占用的内存不超过 database.result_cache_max_bytes (按 ResultSet::memoryCost() 估计)，为 0 时不缓存。
+ * 结果按 key 分散到 16 个分片，每个分片有自己的锁和 1/16 的内存上限，超过时删除这个分片里最久没有使用的结果，
+ * 超过 1/16 上限的单个结果不缓存。表的版本号用读写锁保护，查询只加读锁。
+ *
+ * 注意: 事务里的查询不使用缓存；事务里的写操作由 Transaction 记录下来，在最外层的事务提交或者回滚后才使缓存失效，
+ *      提交前其他线程查询到的旧数据即使被缓存，提交后也会被丢弃。
+ */
+class QueryCache
+{
+    SINGLETON(QueryCache)
+
+public:
+    // 查询前取得的凭证，记录了缓存的 key 和依赖的表的版本号，查询后用来保存结果
+    struct Ticket {
+        bool cacheable;
+        QString key;
+        qint64 ttl;
+        QStringList tables;
+        QVector<quint64> generations;
+
+        Ticket() : cacheable(false), ttl(0) {}
+    };
+
+    /**
+     * @brief 注册语句的缓存策略.
+     * @param sql SQL 语句
+     * @param cache 是否缓存这个语句的结果
+     * @param ttl 缓存的毫秒数，小于等于 0 时使用 database.result_cache_ttl
+     * @param tables 查询依赖的表或者写语句修改的表，cache 为 true 时不能为空，否则不缓存
+     */
+    void registerStatement(const QString &sql, bool cache, qint64 ttl, const QStringList &tables);
+    // 取消注册语句，它的缓存也随之失效
+    void unregisterStatement(const QString &sql);
+
+    /**
+     * @brief 查找缓存的结果.
+     * @param sql SQL 语句
+     * @param params 参数
+     * @param rs 找到时保存结果
+     * @param ticket 没有找到时用来在查询后调用 store()，ticket->cacheable 为 false 时语句不缓存
+     * @return 找到时返回 true
+     */
+    bool lookup(const QString &sql, const QVariantMap &params, ResultSet *rs, Ticket *ticket);
+    // 保存查询的结果
+    void store(const Ticket &ticket, const ResultSet &rs);
+
+    // 写语句 sql 执行后调用，依赖被修改的表的缓存失效
+    void invalidate(const QString &sql);
+    // 依赖表 table 的缓存失效
+    void invalidateTable(const QString &table);
+    // 清空所有缓存
+    void clear();
+
+    // 命中和没有命中的次数
+    qint64 hitCount() const;
+    qint64 missCount() const;
+
+private:
+    class Private;
+    friend class Private;
+    Private *d;
+};
+
+#endif // QUERYCACHE_H
@@ -0,0 +1,147 @@
+#include "ResultSet.h"
+
+#include <QSqlQuery>
+#include <QSqlRecord>
+
+#include <climits>
+
+ResultSet::ResultSet()
+{
+}
+
+ResultSet ResultSet::fromQuery(QSqlQuery *query, int maxRows)
+{
+    ResultSet rs;
+    QSqlRecord record = query->record();
+    int columns = record.count();
+    for (int i = 0; i < columns; ++i) {
+        rs.names << record.fieldName(i);
+        rs.indexes.insert(record.fieldName(i), i);
+    }
+
+    // 知道行数时预先分配好空间
+    int size = maxRows >= 0 ? maxRows : query->size();
+    if (size > 0) {
+        rs.values.reserve(size * columns);
+    }
+    for (int rows = 0; (maxRows < 0 || rows < maxRows) && query->next(); ++rows) {
+        for (int i = 0; i < columns; ++i) {
+            rs.values.append(query->value(i));
+        }
+    }
+    return rs;
+}
+
+int ResultSet::rowCount() const
+{
+    return names.isEmpty() ? 0 : values.size() / names.size();
+}
+
+int ResultSet::columnCount() const
+{
+    return names.size();
+}
+
+bool ResultSet::isEmpty() const
+{
+    return values.isEmpty();
+}
+
+QStringList ResultSet::columnNames() const
+{
+    return names;
+}
+
+int ResultSet::columnIndex(const QString &name) const
+{
+    return indexes.value(name, -1);
+}
+
+QVariant ResultSet::value(int row, int column) const
+{
+    if (row < 0 || row >= rowCount() || column < 0 || column >= names.size()) {
+        return QVariant();
+    }
+    return values.at(row * names.size() + column);
+}
+
+QVariant ResultSet::value(int row, const QString &name) const
+{
+    return value(row, columnIndex(name));
+}
+
+int ResultSet::getInt(int row, int column) const
+{
+    return value(row, column).toInt();
+}
+
+qint64 ResultSet::getInt64(int row, int column) const
+{
+    return value(row, column).toLongLong();
+}
+
+double ResultSet::getDouble(int row, int column) const
+{
+    return value(row, column).toDouble();
+}
+
+bool ResultSet::getBool(int row, int column) const
+{
+    return value(row, column).toBool();
+}
+
+QString ResultSet::getString(int row, int column) const
+{
+    return value(row, column).toString();
+}
+
+QDate ResultSet::getDate(int row, int column) const
+{
+    return value(row, column).toDate();
+}
+
+QDateTime ResultSet::getDateTime(int row, int column) const
+{
+    return value(row, column).toDateTime();
+}
+
+QVariantMap ResultSet::rowMap(int row) const
+{
+    QVariantMap map;
+    if (row < 0 || row >= rowCount()) {
+        return map;
+    }
+    int offset = row * names.size();
+    for (int i = 0; i < names.size(); ++i) {
+        map.insert(names.at(i), values.at(offset + i));
+    }
+    return map;
+}
+
+int ResultSet::memoryCost() const
+{
+    qint64 cost = sizeof(ResultSet) + values.size() * static_cast<qint64>(sizeof(QVariant));
+    for (const QString &name : names) {
+        cost += name.size() * 2 * 2;
+    }
+    for (const QVariant &value : values) {
+        // 只计算常见的变长类型，其他类型保存在 QVariant 里
+        if (value.type() == QVariant::String) {
+            cost += value.toString().size() * 2;
+        } else if (value.type() == QVariant::ByteArray) {
+            cost += value.toByteArray().size();
+        }
+    }
+    return static_cast<int>(qMin<qint64>(cost, INT_MAX));
+}
+
+QList<QVariantMap> ResultSet::toMaps() const
+{
+    QList<QVariantMap> maps;
+    int rows = rowCount();
+    maps.reserve(rows);
+    for (int row = 0; row < rows; ++row) {
+        maps.append(rowMap(row));
+    }
+    return maps;
+}
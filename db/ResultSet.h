@@ -0,0 +1,73 @@
+#ifndef RESULTSET_H
+#define RESULTSET_H
+
+#include <QDate>
+#include <QDateTime>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QVariant>
+#include <QVariantMap>
+#include <QVector>
+
+class QSqlQuery;
+
+/**
+ * 查询结果的紧凑表示，由 DbUtil::selectResultSet() 返回。
+ *
+ * 列名只在读取结果时从 QSqlRecord 解析一次，所有行共享；每一列的值按下标 query->value(i) 读取，
+ * 按行依次存放在一个连续的 QVector<QVariant> 里，不像 QList<QVariantMap> 那样每行都分配一个 map
+ * 并复制所有的列名。按列名访问时先用 columnIndex() 得到下标，在循环外解析一次即可:
+ *      ResultSet rs = DbUtil::selectResultSet(sql);
+ *      int idColumn = rs.columnIndex("id");
+ *      for (int row = 0; row < rs.rowCount(); ++row) {
+ *          int id = rs.getInt(row, idColumn);
+ *      }
+ *
+ * ResultSet 是隐式共享的，复制的开销很小，可以在线程之间传递。
+ */
+class ResultSet
+{
+public:
+    ResultSet();
+
+    // 读取 query 剩下的行，maxRows 为负数时读取所有行，否则最多读取 maxRows 行
+    static ResultSet fromQuery(QSqlQuery *query, int maxRows = -1);
+
+    int rowCount() const;
+    int columnCount() const;
+    bool isEmpty() const;
+
+    // 列名（没用别名就是数据库里的列名）
+    QStringList columnNames() const;
+    // 列名对应的下标，没有这一列时返回 -1
+    int columnIndex(const QString &name) const;
+
+    // 第 row 行第 column 列的值，越界时返回无效的 QVariant
+    QVariant value(int row, int column) const;
+    QVariant value(int row, const QString &name) const;
+
+    int getInt(int row, int column) const;
+    qint64 getInt64(int row, int column) const;
+    double getDouble(int row, int column) const;
+    bool getBool(int row, int column) const;
+    QString getString(int row, int column) const;
+    QDate getDate(int row, int column) const;
+    QDateTime getDateTime(int row, int column) const;
+
+    // 第 row 行映射成 map，Key 是列名，Value 是列值
+    QVariantMap rowMap(int row) const;
+    // 所有行映射成 map 的 list，兼容 DbUtil::selectMaps()
+    QList<QVariantMap> toMaps() const;
+
+    // 估计占用的内存（字节），用于 QueryCache 的内存上限
+    int memoryCost() const;
+
+private:
+    QStringList names;
+    QHash<QString, int> indexes;
+    // 按行存放的值，第 row 行第 column 列在 row * columnCount() + column
+    QVector<QVariant> values;
+};
+
+#endif // RESULTSET_H
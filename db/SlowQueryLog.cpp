@@ -0,0 +1,240 @@
+#include "SlowQueryLog.h"
+#include "util/Config.h"
+
+#include <QAtomicInteger>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QQueue>
+#include <QRandomGenerator>
+#include <QStringList>
+#include <QThread>
+#include <QWaitCondition>
+
+// 等待写入文件的日志的最大条数，超过时丢弃
+static const int QUEUE_CAPACITY = 10000;
+
+// 转义放在双引号里的值，多行的 SQL 和错误信息也只占一行，\ 要最先转义
+static QString quoted(const QString &value)
+{
+    QString result = value;
+    result.replace('\\', "\\\\").replace('"', "\\\"").replace('\n', "\\n").replace('\r', "\\r");
+    return "\"" + result + "\"";
+}
+
+/*-----------------------------------------------------------------------------|
+ |                          d指针 的定义                                        |
+ |----------------------------------------------------------------------------*/
+class SlowQueryLog::Private {
+public:
+    class Writer;
+
+    bool enabled;
+    // 阈值，单位是纳秒
+    qint64 thresholdNanos;
+    int samplePercent;
+    QString fileName;
+    qint64 maxBytes;
+    int maxFiles;
+
+    // 以下成员在 mutex 内访问
+    QMutex mutex;
+    QWaitCondition notEmpty;
+    QQueue<QString> lines;
+    Writer *writer;
+    bool stopping;
+
+    QAtomicInteger<qint64> dropped;
+
+    Private();
+
+    // 在 mutex 内调用，第一次记录日志时启动后台线程
+    void startWriter();
+    // 后台线程取得队列中所有的日志，已经停止并且队列为空时返回 false
+    bool takeLines(QStringList *result);
+    // 后台线程写入日志，需要时轮转文件
+    void write(QFile *file, const QStringList &batch);
+    void rotate(QFile *file);
+};
+
+/**
+ * 后台写日志的线程，每次取出队列中所有的日志一起写入。
+ */
+class SlowQueryLog::Private::Writer : public QThread {
+public:
+    explicit Writer(SlowQueryLog::Private *d) : d(d) {}
+
+protected:
+    void run() Q_DECL_OVERRIDE {
+        QFileInfo info(d->fileName);
+        QDir().mkpath(info.absolutePath());
+        QFile file(d->fileName);
+
+        QStringList batch;
+        while (d->takeLines(&batch)) {
+            d->write(&file, batch);
+            batch.clear();
+        }
+        file.close();
+    }
+
+private:
+    SlowQueryLog::Private *d;
+};
+
+SlowQueryLog::Private::Private() : writer(NULL), stopping(false)
+{
+    Config &config = Singleton<Config>::getInstance();
+    int threshold = config.getDatabaseSlowQueryThreshold();
+    samplePercent = qBound(0, config.getDatabaseSlowQuerySamplePercent(), 100);
+    enabled = threshold >= 0 && samplePercent > 0;
+    thresholdNanos = static_cast<qint64>(threshold) * 1000000;
+    fileName = config.getDatabaseSlowQueryLogFile();
+    maxBytes = qMax(1024, config.getDatabaseSlowQueryLogMaxBytes());
+    maxFiles = qMax(0, config.getDatabaseSlowQueryLogMaxFiles());
+}
+
+void SlowQueryLog::Private::startWriter()
+{
+    if (writer == NULL) {
+        writer = new Writer(this);
+        writer->setObjectName("SlowQueryLogWriter");
+        writer->start(QThread::LowPriority);
+    }
+}
+
+bool SlowQueryLog::Private::takeLines(QStringList *result)
+{
+    QMutexLocker locker(&mutex);
+    while (lines.isEmpty() && !stopping) {
+        notEmpty.wait(&mutex);
+    }
+    if (lines.isEmpty()) {
+        return false;
+    }
+    while (!lines.isEmpty()) {
+        *result << lines.dequeue();
+    }
+    return true;
+}
+
+void SlowQueryLog::Private::write(QFile *file, const QStringList &batch)
+{
+    if (!file->isOpen() && !file->open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text)) {
+        qDebug() << "Cannot open slow query log" << fileName << file->errorString();
+        return;
+    }
+    for (const QString &line : batch) {
+        file->write(line.toUtf8());
+        file->write("\n");
+    }
+    file->flush();
+
+    if (file->size() >= maxBytes) {
+        rotate(file);
+    }
+}
+
+void SlowQueryLog::Private::rotate(QFile *file)
+{
+    file->close();
+    // 删除最旧的，其余的依次加 1
+    QFile::remove(QString("%1.%2").arg(fileName).arg(maxFiles));
+    for (int i = maxFiles - 1; i >= 1; --i) {
+        QFile::rename(QString("%1.%2").arg(fileName).arg(i), QString("%1.%2").arg(fileName).arg(i + 1));
+    }
+    if (maxFiles > 0) {
+        QFile::rename(fileName, fileName + ".1");
+    } else {
+        QFile::remove(fileName);
+    }
+    // 下次写入时重新打开
+}
+
+/*-----------------------------------------------------------------------------|
+ |                             SlowQueryLog 的定义                              |
+ |----------------------------------------------------------------------------*/
+
+SlowQueryLog::SlowQueryLog() : d(new SlowQueryLog::Private)
+{
+}
+
+SlowQueryLog::~SlowQueryLog()
+{
+    release();
+    delete d;
+    d = NULL;
+}
+
+bool SlowQueryLog::isEnabled() const
+{
+    return d->enabled;
+}
+
+bool SlowQueryLog::isSlow(const Timing &timing) const
+{
+    return d->enabled && timing.totalNanos() >= d->thresholdNanos;
+}
+
+void SlowQueryLog::log(const QString &statementId, const QString &sql, const QVariantMap &params,
+                       const Timing &timing, int rows, const QString &error)
+{
+    if (!isSlow(timing)) {
+        return;
+    }
+    if (d->samplePercent < 100 && static_cast<int>(QRandomGenerator::global()->bounded(100)) >= d->samplePercent) {
+        return;
+    }
+
+    // 在调用者的线程里格式化，后台线程只写文件
+    QStringList names;
+    for (QVariantMap::const_iterator i = params.constBegin(); i != params.constEnd(); ++i) {
+        names << i.key() + "=?";
+    }
+    // 拼接而不用 arg()，SQL 里可能有 %1 这样的内容
+    QString line = QDateTime::currentDateTime().toString(Qt::ISODateWithMs)
+            + " slow_query id=" + (statementId.isEmpty() ? QString("-") : statementId)
+            + " total_ms=" + QString::number(timing.totalNanos() / 1000000.0, 'f', 1)
+            + " prepare_ms=" + QString::number(timing.prepareNanos / 1000000.0, 'f', 1)
+            + " exec_ms=" + QString::number(timing.execNanos / 1000000.0, 'f', 1)
+            + " fetch_ms=" + QString::number(timing.fetchNanos / 1000000.0, 'f', 1)
+            + " rows=" + QString::number(rows)
+            + " error=" + quoted(error)
+            + " params={" + names.join(",") + "}"
+            + " sql=" + quoted(sql);
+
+    QMutexLocker locker(&d->mutex);
+    if (d->stopping || d->lines.size() >= QUEUE_CAPACITY) {
+        d->dropped.fetchAndAddRelaxed(1);
+        return;
+    }
+    d->startWriter();
+    d->lines.enqueue(line);
+    d->notEmpty.wakeOne();
+}
+
+qint64 SlowQueryLog::droppedCount() const
+{
+    return d->dropped.load();
+}
+
+void SlowQueryLog::release()
+{
+    Private::Writer *writer;
+    {
+        QMutexLocker locker(&d->mutex);
+        d->stopping = true;
+        d->notEmpty.wakeAll();
+        writer = d->writer;
+        d->writer = NULL;
+    }
+
+    // 后台线程写完队列中剩下的日志后退出
+    if (writer != NULL) {
+        writer->wait();
+        delete writer;
+    }
+}
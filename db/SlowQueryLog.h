@@ -0,0 +1,65 @@
+#ifndef SLOWQUERYLOG_H
+#define SLOWQUERYLOG_H
+
+#include "util/Singleton.h"
+
+#include <QString>
+#include <QVariantMap>
+
+/**
+ * 慢查询日志，DbUtil 执行每条 SQL 时分别记录 prepare、exec 和读取结果 (fetch) 的耗时，
+ * 总耗时超过 database.slow_query_threshold 毫秒的语句按 database.slow_query_sample_percent 的比例记录到日志文件，
+ * 每条一行，例如
+ *      2026-10-16T10:20:30.123 slow_query id=User::findAll total_ms=1523.4 prepare_ms=0.0 exec_ms=1502.1
+ *      fetch_ms=21.3 rows=10000 error="" params={id=?} sql="SELECT ..."
+ * 参数只记录名字，值用 ? 代替，避免密码等敏感数据写入日志。error 和 sql 里的 \、"、换行和回车转义为 \\、\"、\n、\r，
+ * 每条日志总是一行。prepare_ms 是从语句缓存取得或者 prepare 语句的时间，绑定参数计入 exec_ms。
+ *
+ * log() 只把日志放入队列，由后台线程写文件，不会阻塞执行 SQL 的线程；队列满时丢弃并计数。
+ * 文件超过 database.slow_query_log_max_bytes 时轮转: slow_query.log 改名为 slow_query.log.1，
+ * 原来的 .1 改为 .2，以此类推，最多保留 database.slow_query_log_max_files 个旧文件。
+ *
+ * 程序结束前调用 Singleton<SlowQueryLog>::getInstance().release() 写完队列中的日志并停止后台线程。
+ */
+class SlowQueryLog
+{
+    SINGLETON(SlowQueryLog)
+
+public:
+    // 一条 SQL 执行的耗时，单位是纳秒
+    struct Timing {
+        qint64 prepareNanos;
+        qint64 execNanos;
+        qint64 fetchNanos;
+
+        Timing() : prepareNanos(0), execNanos(0), fetchNanos(0) {}
+        qint64 totalNanos() const { return prepareNanos + execNanos + fetchNanos; }
+    };
+
+    // 是否启用，没有启用时调用者不需要计时
+    bool isEnabled() const;
+    // 耗时是否超过了阈值
+    bool isSlow(const Timing &timing) const;
+    /**
+     * @brief 记录一条 SQL，耗时没有超过阈值或者没有被抽中时忽略.
+     * @param statementId SQL 文件中的 namespace::id，临时的 SQL 为空
+     * @param sql sql语句
+     * @param params 参数，只记录名字
+     * @param timing 耗时
+     * @param rows 查询的行数或者影响的行数，不知道时为 -1
+     * @param error 错误信息，没有错误时为空
+     */
+    void log(const QString &statementId, const QString &sql, const QVariantMap &params,
+             const Timing &timing, int rows, const QString &error);
+    // 因为队列满丢弃的日志数
+    qint64 droppedCount() const;
+    // 写完队列中的日志并停止后台线程
+    void release();
+
+private:
+    class Private;
+    friend class Private;
+    Private *d;
+};
+
+#endif // SLOWQUERYLOG_H
@@ -0,0 +1,111 @@
+#include "SqlBundle.h"
+
+#include <QDataStream>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+
+// 文件头 "SQLB"
+static const quint32 BUNDLE_MAGIC = 0x53514C42;
+// 格式或者解析规则改变时增加版本号，旧的 SQL 包会被忽略
+static const quint32 BUNDLE_VERSION = 3;
+
+QHash<QString, SqlFile> SqlBundle::read(const QString &bundleFile)
+{
+    QHash<QString, SqlFile> files;
+    QFile file(bundleFile);
+    if (!file.exists()) {
+        return files;
+    }
+    if (!file.open(QIODevice::ReadOnly) || file.size() == 0) {
+        qDebug() << "Cannot open SQL bundle" << bundleFile << file.errorString();
+        return files;
+    }
+
+    // 映射文件避免把整个包先读入内存再复制一次，映射失败时再读取文件
+    uchar *mapped = file.map(0, file.size());
+    QByteArray data = mapped != NULL ? QByteArray::fromRawData(reinterpret_cast<const char *>(mapped), static_cast<int>(file.size()))
+                                     : file.readAll();
+
+    QDataStream in(data);
+    in.setVersion(QDataStream::Qt_5_0);
+
+    quint32 magic = 0;
+    quint32 version = 0;
+    quint32 fileCount = 0;
+    in >> magic >> version;
+    if (magic != BUNDLE_MAGIC || version != BUNDLE_VERSION) {
+        qDebug() << "Ignore incompatible SQL bundle" << bundleFile;
+        return files;
+    }
+
+    in >> fileCount;
+    for (quint32 i = 0; i < fileCount && in.status() == QDataStream::Ok; ++i) {
+        SqlFile sqlFile;
+        quint32 statementCount = 0;
+        in >> sqlFile.fileName >> sqlFile.hash >> statementCount;
+
+        for (quint32 j = 0; j < statementCount && in.status() == QDataStream::Ok; ++j) {
+            QString sqlNameSpace, id, sql;
+            bool cache = false;
+            qint64 ttl = 0;
+            QStringList tables;
+            bool dynamic = false;
+            SqlTemplatePtr sqlTemplate;
+            in >> sqlNameSpace >> id >> sql >> cache >> ttl >> tables >> dynamic;
+            if (dynamic) {
+                sqlTemplate = SqlTemplatePtr(SqlTemplate::read(in));
+            }
+            sqlFile.statements << SqlStatementPtr(new SqlStatement(sqlNameSpace, id, sql, cache, ttl, tables, sqlTemplate));
+        }
+        sqlFile.valid = true;
+        files.insert(sqlFile.fileName, sqlFile);
+    }
+
+    // 读取的都是复制出来的 QString，data 不再引用映射的内存
+    if (in.status() != QDataStream::Ok) {
+        qDebug() << "Ignore corrupted SQL bundle" << bundleFile;
+        files.clear();
+    }
+    return files;
+}
+
+bool SqlBundle::write(const QString &bundleFile, const QList<SqlFile> &files)
+{
+    QList<SqlFile> validFiles;
+    for (const SqlFile &sqlFile : files) {
+        if (sqlFile.valid) {
+            validFiles << sqlFile;
+        }
+    }
+
+    QDir().mkpath(QFileInfo(bundleFile).absolutePath());
+    // QSaveFile 先写入临时文件，成功后才替换，其他进程不会读到写了一半的包
+    QSaveFile file(bundleFile);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << "Cannot write SQL bundle" << bundleFile << file.errorString();
+        return false;
+    }
+
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_5_0);
+    out << BUNDLE_MAGIC << BUNDLE_VERSION << static_cast<quint32>(validFiles.size());
+    for (const SqlFile &sqlFile : validFiles) {
+        out << sqlFile.fileName << sqlFile.hash << static_cast<quint32>(sqlFile.statements.size());
+        for (const SqlStatementPtr &statement : sqlFile.statements) {
+            out << statement->getNameSpace() << statement->getId() << statement->getSql()
+                << statement->isCache() << statement->getTtl() << statement->getTables() << statement->isDynamic();
+            if (statement->isDynamic()) {
+                statement->getTemplate()->write(out);
+            }
+        }
+    }
+
+    if (out.status() != QDataStream::Ok || !file.commit()) {
+        qDebug() << "Cannot write SQL bundle" << bundleFile << file.errorString();
+        return false;
+    }
+    return true;
+}
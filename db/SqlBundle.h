@@ -0,0 +1,38 @@
+#ifndef SQLBUNDLE_H
+#define SQLBUNDLE_H
+
+#include "db/SqlFileParser.h"
+
+#include <QHash>
+#include <QList>
+#include <QString>
+
+/**
+ * 预编译的 SQL 包，保存所有 SQL 文件解析后的语句 (<include> 已经替换，带有 cache 等属性，
+ * 动态的语句保存编译后的模板) 和文件内容的 SHA-1。
+ *
+ * SqlUtil 启动时用 QFile::map() 映射 SQL 包读取语句，SQL 文件的 SHA-1 和包里记录的相同时不再解析 XML，
+ * 不同 (文件被修改了) 时只重新解析这个文件，然后重新生成 SQL 包。
+ * 包的格式不兼容 (版本不同或者数据损坏) 时忽略整个包。
+ *
+ * SQL 包的路径为 database.sql_bundle，为空时不使用。
+ */
+class SqlBundle
+{
+public:
+    /**
+     * @brief 读取 SQL 包.
+     * @param bundleFile SQL 包的路径
+     * @return key 是 SQL 文件的路径，文件不存在或者格式不兼容时返回空的 QHash
+     */
+    static QHash<QString, SqlFile> read(const QString &bundleFile);
+    /**
+     * @brief 生成 SQL 包，只保存解析成功的文件.
+     * @param bundleFile SQL 包的路径
+     * @param files 解析得到的 SQL 文件
+     * @return 成功返回 true
+     */
+    static bool write(const QString &bundleFile, const QList<SqlFile> &files);
+};
+
+#endif // SQLBUNDLE_H
@@ -0,0 +1,85 @@
+#include "SqlFileParser.h"
+
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QHash>
+#include <QScopedPointer>
+#include <QXmlStreamReader>
+
+// static 全局变量作用域为当前文件
+static const QString SQL_TAGNAME_SQLS = "sqls";
+static const QString SQL_TAGNAME_DEFINE = "define";
+static const QString SQL_TAGNAME_SQL = "sql";
+static const QString SQL_NAMESPACE = "namespace";
+static const QString SQL_ID = "id";
+static const QString SQL_CACHE = "cache";
+static const QString SQL_CACHE_TTL = "ttl";
+static const QString SQL_TABLES = "tables";
+
+static QString buildKey(const QString &sqlNameSpace, const QString &id)
+{
+    return sqlNameSpace + "::" + id;
+}
+
+bool SqlFileParser::parse(const QString &fileName, const QByteArray &content, SqlFile *result)
+{
+    result->fileName = fileName;
+    result->hash = hash(content);
+    result->statements.clear();
+
+    QXmlStreamReader reader(content);
+    QString sqlNameSpace;
+    QHash<QString, QString> defines;
+
+    while (!reader.atEnd()) {
+        reader.readNext();
+        if (!reader.isStartElement()) {
+            continue;
+        }
+
+        QXmlStreamAttributes atts = reader.attributes();
+        if (reader.name() == SQL_TAGNAME_SQLS) {
+            sqlNameSpace = atts.value(SQL_NAMESPACE).toString();
+        } else if (reader.name() == SQL_TAGNAME_DEFINE) {
+            QString defineId = atts.value(SQL_ID).toString();
+            QScopedPointer<SqlTemplate> define(SqlTemplate::parse(&reader, sqlNameSpace, defines));
+            if (define->isDynamic()) {
+                qDebug() << "Dynamic tags are not supported in define：" << buildKey(sqlNameSpace, defineId);
+            }
+            QVariantMap unused;
+            defines.insert(buildKey(sqlNameSpace, defineId), define->render(QVariantMap(), &unused));
+        } else if (reader.name() == SQL_TAGNAME_SQL) {
+            QString sqlId = atts.value(SQL_ID).toString();
+            bool cache = atts.value(SQL_CACHE) == QLatin1String("true");
+            qint64 ttl = atts.value(SQL_CACHE_TTL).toLongLong();
+            QStringList tables = atts.value(SQL_TABLES).toString().split(',', QString::SkipEmptyParts);
+
+            // 没有动态标签的语句只保存 SQL，不需要模板；动态的语句只保存模板，执行时根据参数渲染
+            SqlTemplatePtr sqlTemplate(SqlTemplate::parse(&reader, sqlNameSpace, defines));
+            QString sql;
+            if (!sqlTemplate->isDynamic()) {
+                QVariantMap unused;
+                sql = sqlTemplate->render(QVariantMap(), &unused);
+                sqlTemplate.reset();
+            }
+            result->statements << SqlStatementPtr(new SqlStatement(sqlNameSpace, sqlId, sql, cache, ttl, tables, sqlTemplate));
+        }
+    }
+
+    if (reader.hasError()) {
+        qDebug() << QString("Parse error in %1 at line %2, column %3, message：%4")
+                    .arg(fileName)
+                    .arg(reader.lineNumber())
+                    .arg(reader.columnNumber())
+                    .arg(reader.errorString());
+        result->valid = false;
+        return false;
+    }
+    result->valid = true;
+    return true;
+}
+
+QByteArray SqlFileParser::hash(const QByteArray &content)
+{
+    return QCryptographicHash::hash(content, QCryptographicHash::Sha1);
+}
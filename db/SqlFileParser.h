@@ -0,0 +1,44 @@
+#ifndef SQLFILEPARSER_H
+#define SQLFILEPARSER_H
+
+#include "db/SqlStatement.h"
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+
+/**
+ * 一个 SQL 文件里定义的语句。
+ */
+struct SqlFile {
+    QString fileName;
+    // 文件内容的 SHA-1，用来判断预编译的 SQL 包是否过期
+    QByteArray hash;
+    // 按在文件里出现的顺序保存，<include> 已经替换为 <define> 的内容
+    QList<SqlStatementPtr> statements;
+    // 解析是否成功，失败时 statements 只有出错前的语句
+    bool valid;
+
+    SqlFile() : valid(false) {}
+};
+
+/**
+ * 使用 QXmlStreamReader 解析 SQL 文件，格式参考 SqlUtil.h，<sql> 的内容编译为 SqlTemplate。
+ * <define> 只在定义它的文件内有效，不同的文件可以定义相同 id 的 <define>。
+ */
+class SqlFileParser
+{
+public:
+    /**
+     * @brief 解析 SQL 文件的内容.
+     * @param fileName 文件名，用于记录和输出错误信息
+     * @param content 文件的内容
+     * @param result 保存解析得到的语句
+     * @return 解析成功返回 true，XML 格式错误返回 false
+     */
+    static bool parse(const QString &fileName, const QByteArray &content, SqlFile *result);
+    // 文件内容的 SHA-1
+    static QByteArray hash(const QByteArray &content);
+};
+
+#endif // SQLFILEPARSER_H
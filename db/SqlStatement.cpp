@@ -0,0 +1,81 @@
+#include "SqlStatement.h"
+
+#include <QHash>
+#include <QMutex>
+
+SqlStatement::SqlStatement(const QString &nameSpace, const QString &id, const QString &sql,
+                           bool cache, qint64 ttl, const QStringList &tables,
+                           const SqlTemplatePtr &sqlTemplate)
+    : nameSpace(nameSpace), id(id), statementId(nameSpace + "::" + id), sql(sql),
+      cache(cache), ttl(ttl), tables(tables), sqlTemplate(sqlTemplate)
+{
+}
+
+QString SqlStatement::render(const QVariantMap &params, QVariantMap *boundParams) const
+{
+    if (sqlTemplate.isNull()) {
+        *boundParams = params;
+        return sql;
+    }
+    return sqlTemplate->render(params, boundParams);
+}
+
+/**
+ * 登记的 namespace::id 和下标，下标从 0 开始依次分配，不会删除。
+ * 句柄可能在静态初始化时创建，所以在函数内定义，第一次使用时才构造。
+ */
+struct HandleRegistry {
+    QMutex mutex;
+    QHash<QString, int> indexes;
+    QStringList statementIds;
+};
+
+static HandleRegistry& handleRegistry()
+{
+    static HandleRegistry registry;
+    return registry;
+}
+
+StatementHandle::StatementHandle() : index(-1)
+{
+}
+
+StatementHandle::StatementHandle(const QString &nameSpace, const QString &id)
+{
+    QString statementId = nameSpace + "::" + id;
+    HandleRegistry &registry = handleRegistry();
+
+    QMutexLocker locker(&registry.mutex);
+    QHash<QString, int>::const_iterator i = registry.indexes.constFind(statementId);
+    if (i != registry.indexes.constEnd()) {
+        index = i.value();
+    } else {
+        index = registry.statementIds.size();
+        registry.indexes.insert(statementId, index);
+        registry.statementIds << statementId;
+    }
+}
+
+QString StatementHandle::getStatementId() const
+{
+    if (index < 0) {
+        return QString();
+    }
+    HandleRegistry &registry = handleRegistry();
+    QMutexLocker locker(&registry.mutex);
+    return registry.statementIds.at(index);
+}
+
+StatementHandle StatementHandle::find(const QString &nameSpace, const QString &id)
+{
+    HandleRegistry &registry = handleRegistry();
+    QMutexLocker locker(&registry.mutex);
+    return StatementHandle(registry.indexes.value(nameSpace + "::" + id, -1));
+}
+
+int StatementHandle::count()
+{
+    HandleRegistry &registry = handleRegistry();
+    QMutexLocker locker(&registry.mutex);
+    return registry.statementIds.size();
+}
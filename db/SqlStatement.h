@@ -0,0 +1,96 @@
+#ifndef SQLSTATEMENT_H
+#define SQLSTATEMENT_H
+
+#include "db/SqlTemplate.h"
+
+#include <QSharedPointer>
+#include <QString>
+#include <QStringList>
+#include <QVariantMap>
+
+typedef QSharedPointer<const SqlTemplate> SqlTemplatePtr;
+
+/**
+ * SQL 文件中定义的一条语句，加载后不再修改，可以在多个线程里共享。
+ * 有动态标签 (<if>, <where> 等) 的语句用 render() 根据参数生成 SQL，参考 SqlTemplate.h。
+ */
+class SqlStatement
+{
+public:
+    /**
+     * @param sql 静态的 SQL，动态的语句为空，只能用 render() 生成
+     * @param sqlTemplate 动态的语句编译后的模板，静态的语句为 NULL
+     */
+    SqlStatement(const QString &nameSpace, const QString &id, const QString &sql,
+                 bool cache, qint64 ttl, const QStringList &tables,
+                 const SqlTemplatePtr &sqlTemplate = SqlTemplatePtr());
+
+    QString getNameSpace() const { return nameSpace; }
+    QString getId() const { return id; }
+    // namespace::id
+    QString getStatementId() const { return statementId; }
+    // 静态的 SQL，动态的语句返回空字符串
+    QString getSql() const { return sql; }
+    // <sql> 的 cache, ttl 和 tables 属性
+    bool isCache() const { return cache; }
+    qint64 getTtl() const { return ttl; }
+    QStringList getTables() const { return tables; }
+
+    // 是否有动态标签
+    bool isDynamic() const { return !sqlTemplate.isNull(); }
+    SqlTemplatePtr getTemplate() const { return sqlTemplate; }
+    /**
+     * @brief 根据参数生成 SQL，静态的语句直接返回 getSql().
+     * @param params 参数
+     * @param boundParams 保存执行 SQL 时需要绑定的参数
+     * @return SQL
+     */
+    QString render(const QVariantMap &params, QVariantMap *boundParams) const;
+
+private:
+    const QString nameSpace;
+    const QString id;
+    const QString statementId;
+    const QString sql;
+    const bool cache;
+    const qint64 ttl;
+    const QStringList tables;
+    const SqlTemplatePtr sqlTemplate;
+};
+
+typedef QSharedPointer<const SqlStatement> SqlStatementPtr;
+
+/**
+ * 语句的句柄，只是一个整数，可以在 DAO 里定义为静态变量，例如
+ *      static const StatementHandle SQL_FIND_ALL("User", "findAll");
+ *      QString sql = Singleton<SqlUtil>::getInstance().getSql(SQL_FIND_ALL);
+ *
+ * 创建句柄时把 namespace::id 登记到全局的表里得到它的下标，只在创建时拼接和计算 hash，
+ * 不需要先加载 SQL 文件，所以可以在静态初始化时创建；SqlUtil 按下标保存语句，
+ * 之后用句柄取得语句只是访问数组，没有字符串的拼接和 hash 计算。
+ * 同一个 namespace::id 的句柄总是相同的下标。
+ */
+class StatementHandle
+{
+public:
+    // 无效的句柄
+    StatementHandle();
+    StatementHandle(const QString &nameSpace, const QString &id);
+
+    bool isValid() const { return index >= 0; }
+    int getIndex() const { return index; }
+    // namespace::id
+    QString getStatementId() const;
+
+    // 查找已经登记的句柄，不登记新的句柄，找不到时返回无效的句柄
+    static StatementHandle find(const QString &nameSpace, const QString &id);
+    // 已经登记的句柄的个数
+    static int count();
+
+private:
+    explicit StatementHandle(int index) : index(index) {}
+
+    int index;
+};
+
+#endif // SQLSTATEMENT_H
@@ -0,0 +1,696 @@
+#include "SqlTemplate.h"
+
+#include <QDataStream>
+#include <QDebug>
+#include <QList>
+#include <QRegularExpression>
+#include <QSharedPointer>
+#include <QStringList>
+#include <QXmlStreamReader>
+
+// static 全局变量作用域为当前文件
+static const QString SQL_TAGNAME_INCLUDE = "include";
+static const QString SQL_TAGNAME_IF = "if";
+static const QString SQL_TAGNAME_WHERE = "where";
+static const QString SQL_TAGNAME_SET = "set";
+static const QString SQL_TAGNAME_CHOOSE = "choose";
+static const QString SQL_TAGNAME_WHEN = "when";
+static const QString SQL_TAGNAME_OTHERWISE = "otherwise";
+static const QString SQL_TAGNAME_FOREACH = "foreach";
+static const QString SQL_INCLUDE_DEFINE_ID = "defineId";
+static const QString SQL_TEST = "test";
+static const QString SQL_COLLECTION = "collection";
+static const QString SQL_ITEM = "item";
+static const QString SQL_INDEX = "index";
+static const QString SQL_OPEN = "open";
+static const QString SQL_SEPARATOR = "separator";
+static const QString SQL_CLOSE = "close";
+
+/*-----------------------------------------------------------------------------|
+ |                              test 表达式                                     |
+ |----------------------------------------------------------------------------*/
+
+struct Expression;
+typedef QSharedPointer<const Expression> ExpressionPtr;
+
+struct Expression {
+    enum Type { Constant, Variable, Not, And, Or, Compare };
+
+    Type type;
+    // Constant 的值，null 为无效的 QVariant
+    QVariant value;
+    // Variable 的参数名和属性 (size 或者 length)
+    QString name;
+    QString property;
+    // Compare 的运算符
+    QString op;
+    ExpressionPtr left;
+    ExpressionPtr right;
+
+    explicit Expression(Type type) : type(type) {}
+};
+
+/**
+ * 把 test 表达式编译为 Expression，加载 SQL 文件时执行一次。
+ */
+class ExpressionParser {
+public:
+    explicit ExpressionParser(const QString &source) : source(source), pos(0), failed(false) {}
+
+    // 表达式有错误时返回 NULL
+    ExpressionPtr parse() {
+        if (!tokenize()) {
+            return ExpressionPtr();
+        }
+        ExpressionPtr expression = parseOr();
+        if (failed || pos != tokens.size()) {
+            qDebug() << "Invalid test expression in SQL:" << source;
+            return ExpressionPtr();
+        }
+        return expression;
+    }
+
+private:
+    enum TokenType { Name, Number, String, Operator };
+
+    struct Token {
+        TokenType type;
+        QString text;
+    };
+
+    bool tokenize() {
+        static const QStringList operators = QStringList() << "==" << "!=" << "<=" << ">=" << "&&" << "||"
+                                                           << "<" << ">" << "!" << "(" << ")";
+        int i = 0;
+        while (i < source.size()) {
+            QChar ch = source.at(i);
+            int start = i;
+            Token token;
+
+            if (ch.isSpace()) {
+                ++i;
+                continue;
+            } else if (ch.isLetter() || ch == '_') {
+                while (i < source.size() && (source.at(i).isLetterOrNumber() || source.at(i) == '_' || source.at(i) == '.')) {
+                    ++i;
+                }
+                token.type = Name;
+                token.text = source.mid(start, i - start);
+            } else if (ch.isDigit()) {
+                while (i < source.size() && (source.at(i).isDigit() || source.at(i) == '.')) {
+                    ++i;
+                }
+                token.type = Number;
+                token.text = source.mid(start, i - start);
+            } else if (ch == '\'') {
+                int end = source.indexOf('\'', i + 1);
+                if (end < 0) {
+                    qDebug() << "Unterminated string in SQL test expression:" << source;
+                    return false;
+                }
+                token.type = String;
+                token.text = source.mid(i + 1, end - i - 1);
+                i = end + 1;
+            } else {
+                token.type = Operator;
+                for (const QString &op : operators) {
+                    if (source.midRef(i, op.size()) == op) {
+                        token.text = op;
+                        break;
+                    }
+                }
+                if (token.text.isEmpty()) {
+                    qDebug() << "Invalid character in SQL test expression:" << source;
+                    return false;
+                }
+                i += token.text.size();
+            }
+            tokens << token;
+        }
+        return true;
+    }
+
+    // 当前的 token 是运算符或者关键字 text 时跳过它并返回 true
+    bool accept(const QString &text) {
+        if (pos < tokens.size() && tokens.at(pos).type != String && tokens.at(pos).text == text) {
+            ++pos;
+            return true;
+        }
+        return false;
+    }
+
+    ExpressionPtr binary(Expression::Type type, const ExpressionPtr &left, const ExpressionPtr &right, const QString &op = QString()) {
+        Expression *expression = new Expression(type);
+        expression->left = left;
+        expression->right = right;
+        expression->op = op;
+        return ExpressionPtr(expression);
+    }
+
+    ExpressionPtr parseOr() {
+        ExpressionPtr left = parseAnd();
+        while (!failed && (accept("or") || accept("||"))) {
+            left = binary(Expression::Or, left, parseAnd());
+        }
+        return left;
+    }
+
+    ExpressionPtr parseAnd() {
+        ExpressionPtr left = parseNot();
+        while (!failed && (accept("and") || accept("&&"))) {
+            left = binary(Expression::And, left, parseNot());
+        }
+        return left;
+    }
+
+    ExpressionPtr parseNot() {
+        if (accept("not") || accept("!")) {
+            return binary(Expression::Not, parseNot(), ExpressionPtr());
+        }
+        return parseCompare();
+    }
+
+    ExpressionPtr parseCompare() {
+        static const QStringList comparisons = QStringList() << "==" << "!=" << "<=" << ">=" << "<" << ">";
+        ExpressionPtr left = parsePrimary();
+        for (const QString &op : comparisons) {
+            if (accept(op)) {
+                return binary(Expression::Compare, left, parsePrimary(), op);
+            }
+        }
+        return left;
+    }
+
+    ExpressionPtr parsePrimary() {
+        if (failed || pos >= tokens.size()) {
+            failed = true;
+            return ExpressionPtr();
+        }
+
+        if (accept("(")) {
+            ExpressionPtr expression = parseOr();
+            if (!accept(")")) {
+                failed = true;
+            }
+            return expression;
+        }
+
+        Token token = tokens.at(pos++);
+        Expression *expression = new Expression(Expression::Constant);
+        if (token.type == Number) {
+            expression->value = token.text.contains('.') ? QVariant(token.text.toDouble()) : QVariant(token.text.toLongLong());
+        } else if (token.type == String) {
+            // '' 是空字符串，不是 null
+            expression->value = token.text.isNull() ? QString("") : token.text;
+        } else if (token.type == Name && token.text == "null") {
+            expression->value = QVariant();
+        } else if (token.type == Name && (token.text == "true" || token.text == "false")) {
+            expression->value = token.text == "true";
+        } else if (token.type == Name) {
+            expression->type = Expression::Variable;
+            expression->name = token.text;
+            int dot = token.text.lastIndexOf('.');
+            QString property = token.text.mid(dot + 1);
+            if (dot > 0 && (property == "size" || property == "length")) {
+                expression->name = token.text.left(dot);
+                expression->property = property;
+            }
+        } else {
+            failed = true;
+        }
+        return ExpressionPtr(expression);
+    }
+
+    QString source;
+    QList<Token> tokens;
+    int pos;
+    bool failed;
+};
+
+static bool isNullValue(const QVariant &value)
+{
+    return !value.isValid() || value.isNull();
+}
+
+// 数字、bool 和内容是数字的字符串转为 double
+static bool toNumber(const QVariant &value, double *number)
+{
+    switch (value.userType()) {
+    case QMetaType::Bool:
+    case QMetaType::Int:
+    case QMetaType::UInt:
+    case QMetaType::Long:
+    case QMetaType::ULong:
+    case QMetaType::LongLong:
+    case QMetaType::ULongLong:
+    case QMetaType::Short:
+    case QMetaType::UShort:
+    case QMetaType::Float:
+    case QMetaType::Double:
+        *number = value.toDouble();
+        return true;
+    case QMetaType::QString: {
+        bool ok = false;
+        *number = value.toString().toDouble(&ok);
+        return ok;
+    }
+    default:
+        return false;
+    }
+}
+
+// 条件是否成立: null、false、0、空字符串和空列表不成立
+static bool isTrue(const QVariant &value)
+{
+    if (isNullValue(value)) {
+        return false;
+    }
+    switch (value.userType()) {
+    case QMetaType::Bool:
+        return value.toBool();
+    case QMetaType::QString:
+        return !value.toString().isEmpty();
+    case QMetaType::QStringList:
+    case QMetaType::QVariantList:
+        return !value.toList().isEmpty();
+    case QMetaType::QVariantMap:
+        return !value.toMap().isEmpty();
+    default: {
+        double number = 0;
+        return toNumber(value, &number) ? number != 0 : true;
+    }
+    }
+}
+
+static QVariant evaluate(const Expression *expression, const QVariantMap &scope)
+{
+    if (expression == NULL) {
+        return QVariant();
+    }
+
+    switch (expression->type) {
+    case Expression::Constant:
+        return expression->value;
+    case Expression::Variable: {
+        QVariant value = scope.value(expression->name);
+        if (expression->property.isEmpty() || isNullValue(value)) {
+            return value;
+        }
+        switch (value.userType()) {
+        case QMetaType::QStringList:
+        case QMetaType::QVariantList:
+            return value.toList().size();
+        case QMetaType::QVariantMap:
+            return value.toMap().size();
+        default:
+            return value.toString().size();
+        }
+    }
+    case Expression::Not:
+        return !isTrue(evaluate(expression->left.data(), scope));
+    case Expression::And:
+        return isTrue(evaluate(expression->left.data(), scope)) && isTrue(evaluate(expression->right.data(), scope));
+    case Expression::Or:
+        return isTrue(evaluate(expression->left.data(), scope)) || isTrue(evaluate(expression->right.data(), scope));
+    case Expression::Compare: {
+        QVariant a = evaluate(expression->left.data(), scope);
+        QVariant b = evaluate(expression->right.data(), scope);
+        const QString &op = expression->op;
+        if (isNullValue(a) || isNullValue(b)) {
+            bool equal = isNullValue(a) && isNullValue(b);
+            return op == "==" ? equal : (op == "!=" ? !equal : false);
+        }
+
+        int result;
+        double x = 0;
+        double y = 0;
+        if (toNumber(a, &x) && toNumber(b, &y)) {
+            result = x < y ? -1 : (x > y ? 1 : 0);
+        } else {
+            result = QString::compare(a.toString(), b.toString());
+        }
+
+        if (op == "==") return result == 0;
+        if (op == "!=") return result != 0;
+        if (op == "<") return result < 0;
+        if (op == "<=") return result <= 0;
+        if (op == ">") return result > 0;
+        return result >= 0;
+    }
+    }
+    return QVariant();
+}
+
+/*-----------------------------------------------------------------------------|
+ |                                模板的节点                                     |
+ |----------------------------------------------------------------------------*/
+
+struct TemplateNode;
+typedef QSharedPointer<TemplateNode> NodePtr;
+
+struct TemplateNode {
+    enum Type { Text, If, Where, Set, Choose, When, Otherwise, Foreach };
+
+    Type type;
+    // Text 的内容，已经合并空白
+    QString text;
+    // Text 按命名参数切分，literals 比 placeholders 多一个: literal0 :placeholder0 literal1 ...
+    QStringList literals;
+    QStringList placeholders;
+    // If 和 When 的条件
+    QString test;
+    ExpressionPtr expression;
+    // Foreach 的属性
+    QString collection;
+    QString item;
+    QString index;
+    QString open;
+    QString separator;
+    QString close;
+    QList<NodePtr> children;
+
+    explicit TemplateNode(Type type) : type(type) {}
+};
+
+// 编译节点的 test 表达式和 Text 的命名参数，解析 XML 和读取 SQL 包后调用
+static void prepareNode(TemplateNode *node)
+{
+    if (node->type == TemplateNode::If || node->type == TemplateNode::When) {
+        node->expression = ExpressionParser(node->test).parse();
+    } else if (node->type == TemplateNode::Text) {
+        // :name 是命名参数，排除 PostgreSQL 的类型转换 ::type
+        static const QRegularExpression placeholder("(?<![:\\w]):([A-Za-z_]\\w*)");
+        int last = 0;
+        QRegularExpressionMatchIterator i = placeholder.globalMatch(node->text);
+        while (i.hasNext()) {
+            QRegularExpressionMatch match = i.next();
+            node->literals << node->text.mid(last, match.capturedStart() - last);
+            node->placeholders << match.captured(1);
+            last = match.capturedEnd();
+        }
+        node->literals << node->text.mid(last);
+    }
+}
+
+// 保存积累的文本，空白的文本忽略
+static void flushText(QString *text, QList<NodePtr> *nodes)
+{
+    QString simplified = text->simplified();
+    text->clear();
+    if (!simplified.isEmpty()) {
+        NodePtr node(new TemplateNode(TemplateNode::Text));
+        node->text = simplified;
+        prepareNode(node.data());
+        nodes->append(node);
+    }
+}
+
+/**
+ * 读取当前元素的内容直到它结束，相邻的文本和 <include> 合并为一个 Text。
+ */
+static void parseNodes(QXmlStreamReader *reader, const QString &sqlNameSpace,
+                       const QHash<QString, QString> &defines, QList<NodePtr> *nodes)
+{
+    QString text;
+    while (!reader->atEnd()) {
+        reader->readNext();
+        if (reader->isCharacters()) {
+            text += reader->text();
+            continue;
+        }
+        if (reader->isEndElement()) {
+            break;
+        }
+        if (!reader->isStartElement()) {
+            continue;
+        }
+
+        QXmlStreamAttributes atts = reader->attributes();
+        if (reader->name() == SQL_TAGNAME_INCLUDE) {
+            QString defineKey = sqlNameSpace + "::" + atts.value(SQL_INCLUDE_DEFINE_ID).toString();
+            QString defineValue = defines.value(defineKey);
+            if (!defineValue.isEmpty()) {
+                //将定义的片段拼接进 sql
+                text += defineValue;
+            } else {
+                qDebug() << "Cannot find define：" << defineKey;
+            }
+            reader->skipCurrentElement();
+            continue;
+        }
+
+        NodePtr node;
+        if (reader->name() == SQL_TAGNAME_IF) {
+            node = NodePtr(new TemplateNode(TemplateNode::If));
+        } else if (reader->name() == SQL_TAGNAME_WHERE) {
+            node = NodePtr(new TemplateNode(TemplateNode::Where));
+        } else if (reader->name() == SQL_TAGNAME_SET) {
+            node = NodePtr(new TemplateNode(TemplateNode::Set));
+        } else if (reader->name() == SQL_TAGNAME_CHOOSE) {
+            node = NodePtr(new TemplateNode(TemplateNode::Choose));
+        } else if (reader->name() == SQL_TAGNAME_WHEN) {
+            node = NodePtr(new TemplateNode(TemplateNode::When));
+        } else if (reader->name() == SQL_TAGNAME_OTHERWISE) {
+            node = NodePtr(new TemplateNode(TemplateNode::Otherwise));
+        } else if (reader->name() == SQL_TAGNAME_FOREACH) {
+            node = NodePtr(new TemplateNode(TemplateNode::Foreach));
+        } else {
+            qDebug() << "Unknown tag in SQL：" << reader->name().toString();
+            reader->skipCurrentElement();
+            continue;
+        }
+
+        flushText(&text, nodes);
+        node->test = atts.value(SQL_TEST).toString();
+        node->collection = atts.value(SQL_COLLECTION).toString();
+        node->item = atts.value(SQL_ITEM).toString();
+        node->index = atts.value(SQL_INDEX).toString();
+        node->open = atts.value(SQL_OPEN).toString();
+        node->separator = atts.value(SQL_SEPARATOR).toString();
+        node->close = atts.value(SQL_CLOSE).toString();
+        parseNodes(reader, sqlNameSpace, defines, &node->children);
+        prepareNode(node.data());
+        nodes->append(node);
+    }
+    flushText(&text, nodes);
+}
+
+static void writeNodes(QDataStream &out, const QList<NodePtr> &nodes)
+{
+    out << static_cast<quint32>(nodes.size());
+    for (const NodePtr &node : nodes) {
+        out << static_cast<quint8>(node->type) << node->text << node->test
+            << node->collection << node->item << node->index << node->open << node->separator << node->close;
+        writeNodes(out, node->children);
+    }
+}
+
+static bool readNodes(QDataStream &in, QList<NodePtr> *nodes)
+{
+    quint32 count = 0;
+    in >> count;
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        quint8 type = 0;
+        in >> type;
+        if (type > TemplateNode::Foreach) {
+            in.setStatus(QDataStream::ReadCorruptData);
+            return false;
+        }
+
+        NodePtr node(new TemplateNode(static_cast<TemplateNode::Type>(type)));
+        in >> node->text >> node->test
+           >> node->collection >> node->item >> node->index >> node->open >> node->separator >> node->close;
+        if (!readNodes(in, &node->children)) {
+            return false;
+        }
+        prepareNode(node.data());
+        nodes->append(node);
+    }
+    return in.status() == QDataStream::Ok;
+}
+
+/*-----------------------------------------------------------------------------|
+ |                          d指针 的定义                                        |
+ |----------------------------------------------------------------------------*/
+
+// 一次渲染的状态
+struct RenderContext {
+    // 参数和 <foreach> 的 item, index
+    QVariantMap scope;
+    // SQL 里用到的参数
+    QVariantMap *boundParams;
+    // <foreach> 的 item 和 index 重命名后的参数名
+    QHash<QString, QString> renames;
+    // 已经展开的 <foreach> 的元素个数，用来生成不重复的参数名
+    int expanded;
+};
+
+class SqlTemplate::Private {
+public:
+    QList<NodePtr> nodes;
+    bool dynamic;
+
+    Private() : dynamic(false) {}
+
+    static QString renderNodes(const QList<NodePtr> &nodes, RenderContext *context);
+    static QString renderNode(const TemplateNode *node, RenderContext *context);
+    static QString renderText(const TemplateNode *node, RenderContext *context);
+    static QString renderForeach(const TemplateNode *node, RenderContext *context);
+};
+
+QString SqlTemplate::Private::renderNodes(const QList<NodePtr> &nodes, RenderContext *context)
+{
+    // 各部分之间用一个空格分隔
+    QString sql;
+    for (const NodePtr &node : nodes) {
+        QString part = renderNode(node.data(), context);
+        if (!part.isEmpty()) {
+            if (!sql.isEmpty()) {
+                sql += ' ';
+            }
+            sql += part;
+        }
+    }
+    return sql;
+}
+
+QString SqlTemplate::Private::renderNode(const TemplateNode *node, RenderContext *context)
+{
+    switch (node->type) {
+    case TemplateNode::Text:
+        return renderText(node, context);
+    case TemplateNode::If:
+    case TemplateNode::When:
+        return isTrue(evaluate(node->expression.data(), context->scope)) ? renderNodes(node->children, context) : QString();
+    case TemplateNode::Otherwise:
+        return renderNodes(node->children, context);
+    case TemplateNode::Where: {
+        static const QRegularExpression leading("^(AND|OR)\\b\\s*", QRegularExpression::CaseInsensitiveOption);
+        QString content = renderNodes(node->children, context).remove(leading);
+        return content.isEmpty() ? QString() : "WHERE " + content;
+    }
+    case TemplateNode::Set: {
+        static const QRegularExpression trailing("\\s*,$");
+        QString content = renderNodes(node->children, context).remove(trailing);
+        return content.isEmpty() ? QString() : "SET " + content;
+    }
+    case TemplateNode::Choose:
+        for (const NodePtr &child : node->children) {
+            if (child->type == TemplateNode::Otherwise
+                    || (child->type == TemplateNode::When && isTrue(evaluate(child->expression.data(), context->scope)))) {
+                return renderNodes(child->children, context);
+            }
+        }
+        return QString();
+    case TemplateNode::Foreach:
+        return renderForeach(node, context);
+    }
+    return QString();
+}
+
+QString SqlTemplate::Private::renderText(const TemplateNode *node, RenderContext *context)
+{
+    if (node->placeholders.isEmpty()) {
+        return node->text;
+    }
+
+    QString sql;
+    sql.reserve(node->text.size() + 16);
+    for (int i = 0; i < node->placeholders.size(); ++i) {
+        const QString &name = node->placeholders.at(i);
+        QString boundName = context->renames.value(name, name);
+        sql += node->literals.at(i);
+        sql += ':';
+        sql += boundName;
+        // 没有传入的参数不绑定，和直接执行 SQL 一样由驱动报错
+        QVariantMap::const_iterator value = context->scope.constFind(name);
+        if (value != context->scope.constEnd()) {
+            context->boundParams->insert(boundName, value.value());
+        }
+    }
+    sql += node->literals.last();
+    return sql;
+}
+
+QString SqlTemplate::Private::renderForeach(const TemplateNode *node, RenderContext *context)
+{
+    QVariantList values = context->scope.value(node->collection).toList();
+    if (values.isEmpty()) {
+        return QString();
+    }
+
+    // 嵌套的 <foreach> 可能使用相同的名字，展开后恢复
+    QVariantMap savedScope = context->scope;
+    QHash<QString, QString> savedRenames = context->renames;
+
+    QStringList parts;
+    for (int i = 0; i < values.size(); ++i) {
+        QString suffix = "_" + QString::number(context->expanded++);
+        if (!node->item.isEmpty()) {
+            context->scope.insert(node->item, values.at(i));
+            context->renames.insert(node->item, "__" + node->item + suffix);
+        }
+        if (!node->index.isEmpty()) {
+            context->scope.insert(node->index, i);
+            context->renames.insert(node->index, "__" + node->index + suffix);
+        }
+        parts << renderNodes(node->children, context);
+    }
+
+    context->scope = savedScope;
+    context->renames = savedRenames;
+    return node->open + parts.join(node->separator) + node->close;
+}
+
+/*-----------------------------------------------------------------------------|
+ |                             SqlTemplate 的定义                               |
+ |----------------------------------------------------------------------------*/
+
+SqlTemplate::SqlTemplate() : d(new SqlTemplate::Private)
+{
+}
+
+SqlTemplate::~SqlTemplate()
+{
+    delete d;
+    d = NULL;
+}
+
+SqlTemplate *SqlTemplate::parse(QXmlStreamReader *reader, const QString &sqlNameSpace, const QHash<QString, QString> &defines)
+{
+    SqlTemplate *sqlTemplate = new SqlTemplate();
+    parseNodes(reader, sqlNameSpace, defines, &sqlTemplate->d->nodes);
+    for (const NodePtr &node : sqlTemplate->d->nodes) {
+        sqlTemplate->d->dynamic = sqlTemplate->d->dynamic || node->type != TemplateNode::Text;
+    }
+    return sqlTemplate;
+}
+
+bool SqlTemplate::isDynamic() const
+{
+    return d->dynamic;
+}
+
+QString SqlTemplate::render(const QVariantMap &params, QVariantMap *boundParams) const
+{
+    RenderContext context;
+    context.scope = params;
+    context.boundParams = boundParams;
+    context.expanded = 0;
+    return Private::renderNodes(d->nodes, &context);
+}
+
+void SqlTemplate::write(QDataStream &out) const
+{
+    writeNodes(out, d->nodes);
+}
+
+SqlTemplate *SqlTemplate::read(QDataStream &in)
+{
+    SqlTemplate *sqlTemplate = new SqlTemplate();
+    readNodes(in, &sqlTemplate->d->nodes);
+    for (const NodePtr &node : sqlTemplate->d->nodes) {
+        sqlTemplate->d->dynamic = sqlTemplate->d->dynamic || node->type != TemplateNode::Text;
+    }
+    return sqlTemplate;
+}
@@ -0,0 +1,73 @@
+#ifndef SQLTEMPLATE_H
+#define SQLTEMPLATE_H
+
+#include <QHash>
+#include <QString>
+#include <QVariantMap>
+
+class QDataStream;
+class QXmlStreamReader;
+
+/**
+ * <sql> 编译后的模板，加载 SQL 文件时编译一次，执行时根据参数渲染出使用命名参数的 SQL。
+ *
+ * 支持的动态标签 (和 MyBatis 类似):
+ *     <if test="表达式">...</if>                条件成立时才输出内容
+ *     <where>...</where>                       内容不为空时输出 WHERE，并去掉开头的 AND 或 OR
+ *     <set>...</set>                           内容不为空时输出 SET，并去掉结尾的逗号
+ *     <choose>                                 输出第一个条件成立的 <when>，都不成立时输出 <otherwise>
+ *         <when test="表达式">...</when>
+ *         <otherwise>...</otherwise>
+ *     </choose>
+ *     <foreach collection="ids" item="id" index="i" open="(" separator="," close=")">:id</foreach>
+ *                                              对 collection 参数 (QVariantList 或者 QStringList) 的每个元素输出一次内容，
+ *                                              内容里的 :id 重命名为 :__id_0, :__id_1 ... 并绑定元素的值
+ *
+ * test 表达式支持参数名、null、true、false、数字、单引号括起来的字符串，比较 == != < <= > >=，
+ * 逻辑运算 and or not (或者 && || !) 和括号，参数名后面可以用 .size 或者 .length 取得列表或者字符串的长度，如
+ *     <if test="username != null and username != ''">AND username=:username</if>
+ *     <if test="ids != null and ids.size > 0">AND id IN <foreach ...>:id</foreach></if>
+ * 没有传入的参数为 null，条件判断时 null、false、0、空字符串和空列表都不成立。
+ *
+ * 值只通过绑定参数传递，不会拼接到 SQL 里，所以参数的值不同而条件相同时渲染出相同的 SQL，
+ * 可以复用已经 prepare 的语句 (StatementCache) 和数据库的执行计划；<foreach> 的元素个数不同时 SQL 不同。
+ */
+class SqlTemplate
+{
+public:
+    ~SqlTemplate();
+
+    /**
+     * @brief 编译 <sql> 或者 <define> 的内容.
+     * @param reader 当前位置是元素的开始，返回时是元素的结束
+     * @param sqlNameSpace 当前的 namespace，用于查找 <include> 引用的 <define>
+     * @param defines 已经定义的 <define>，key 是 namespace::id
+     * @return 编译后的模板，由调用者拥有
+     */
+    static SqlTemplate* parse(QXmlStreamReader *reader, const QString &sqlNameSpace, const QHash<QString, QString> &defines);
+
+    // 是否有动态标签，没有时 render() 的结果总是相同的
+    bool isDynamic() const;
+    /**
+     * @brief 渲染 SQL.
+     * @param params 参数
+     * @param boundParams 保存 SQL 里用到的参数，包括 <foreach> 展开的参数，用于绑定
+     * @return 合并空白后的 SQL
+     */
+    QString render(const QVariantMap &params, QVariantMap *boundParams) const;
+
+    // 写入 SQL 包
+    void write(QDataStream &out) const;
+    // 从 SQL 包读取，由调用者拥有
+    static SqlTemplate* read(QDataStream &in);
+
+private:
+    SqlTemplate();
+    Q_DISABLE_COPY(SqlTemplate)
+
+    class Private;
+    friend class Private;
+    Private *d;
+};
+
+#endif // SQLTEMPLATE_H
@@ -1,172 +1,431 @@
 #include "SqlUtil.h"
 #include "util/Config.h"
+#include "db/QueryCache.h"
+#include "db/SqlBundle.h"
+#include "db/SqlFileParser.h"
+#include "db/SqlStatement.h"
+#include "db/StatementCache.h"
 
+#include <QDataStream>
 #include <QDebug>
 #include <QString>
 #include <QHash>
-#include <QXmlParseException>
+#include <QReadWriteLock>
+#include <QSet>
+#include <QSharedPointer>
+#include <QVector>
 #include <QFile>
-#include <QXmlInputSource>
-#include <QXmlSimpleReader>
-#include <QXmlDefaultHandler>
+#include <QFileSystemWatcher>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+#include <QTimer>
 
+// 文件修改后等待的毫秒数，编辑器保存时可能连续触发多次修改，合并为一次重新加载
+static const int RELOAD_DELAY = 300;
+// 最多记录的动态语句渲染出的 SQL 数，<foreach> 的元素个数不同时 SQL 也不同，需要限制
+static const int MAX_RENDERED_SQLS = 1000;
 
+/**
+ * 某一时刻加载的所有语句，发布后不再修改。
+ * 热加载时生成新的 SqlCatalog 替换旧的，读取语句的线程持有取得时的共享指针，
+ * 旧的 SqlCatalog 在最后一个持有它的线程用完后自动删除。
+ */
+struct SqlCatalog {
+    // 按 sql_files 的顺序，打开失败的文件只有 fileName
+    QVector<SqlFile> files;
+    // 下标是 StatementHandle 的下标，没有定义的语句为 NULL
+    QVector<SqlStatementPtr> statements;
+    // Key 是静态的 SQL 语句，value 是 namespace::id，动态的语句渲染出的 SQL 不固定，不在这里
+    QHash<QString, QString> statementIds;
+};
 
-// static 全局变量作用域为当前文件
-static const QString SQL_TAGNAME_SQLS = "sqls";
-static const QString SQL_TAGNAME_DEFINE = "define";
-static const QString SQL_TAGNAME_SQL = "sql";
-static const QString SQL_TAGNAME_INCLUDE = "include";
-static const QString SQL_NAMESPACE = "namespace";
-static const QString SQL_ID = "id";
-static const QString SQL_INCLUDE_DEFINE_ID = "defineId";
+typedef QSharedPointer<const SqlCatalog> SqlCatalogPtr;
 
 /*-----------------------------------------------------------------------------|
  |                         d指针 implementation                          |
  |----------------------------------------------------------------------------*/
 
-class SqlUtil::Private : public QXmlDefaultHandler {
+class SqlUtil::Private {
 public:
-    // Key 是 id, value 是 SQL 语句
+    class LoadTask;
+
+    // 一个 SQL 文件的加载结果
+    struct LoadResult {
+        SqlFile file;
+        // 文件是否能打开
+        bool opened;
+        // 是否解析了 XML，为 false 时使用的是 SQL 包里的语句
+        bool parsed;
+
+        LoadResult() : opened(false), parsed(false) {}
+    };
+
+    QStringList sqlFiles;
+    QString bundleFile;
+
+    // 当前的语句，只用 current() 读取，publish() 替换。锁只保护复制和替换共享指针，时间很短
+    mutable QReadWriteLock catalogLock;
+    SqlCatalogPtr catalog;
+    // 动态语句渲染出的 SQL 到 namespace::id 的映射，最多 MAX_RENDERED_SQLS 条，在 renderedLock 内访问
+    mutable QReadWriteLock renderedLock;
+    QHash<QString, QString> renderedIds;
+
+    // 热加载，watcher 和 reloadTimer 属于 watchThread，只在 watchThread 里使用
+    QThread *watchThread;
+    QFileSystemWatcher *watcher;
+    QTimer *reloadTimer;
+    // 被修改了，等待重新加载的文件
+    QSet<QString> changedFiles;
 
     Private();
-    QString buildKey(const QString &sqlNameSpace, const QString &sqlId);
+    ~Private();
 
-    QHash<QString, QString> getSqls() const;
+    SqlCatalogPtr current() const;
+    void publish(const SqlCatalogPtr &newCatalog);
+
+    // 读取一个文件，没有修改时使用 SQL 包里的语句，否则解析 XML，可以在多个线程里同时调用
+    static void loadFile(const QString &fileName, const QHash<QString, SqlFile> &bundledFiles, LoadResult *result);
+    // 按文件的顺序合并语句，重复的 id 后面的文件覆盖前面的
+    static SqlCatalog* buildCatalog(const QVector<SqlFile> &files);
+    // 语句的内容或者属性是否不同
+    static bool isModified(const SqlStatementPtr &a, const SqlStatementPtr &b);
+    // 动态语句的模板序列化后的内容，用来比较模板是否改变
+    static QByteArray templateBytes(const SqlStatementPtr &statement);
+    // 更新修改了的语句的查询结果缓存和 prepare 的语句的缓存，oldCatalog 为 NULL 表示第一次加载
+    static void applyChanges(const SqlCatalog *oldCatalog, const SqlCatalog *newCatalog);
+    // 记录动态语句渲染出的 SQL 属于哪个语句，统计和慢查询日志用它找到 namespace::id
+    void recordRendered(const QString &sql, const QString &statementId);
+
+    // 在 watchThread 里监视 SQL 文件
+    void startWatching();
+    void stopWatching();
+    // 文件被修改，在 watchThread 里调用
+    void fileChanged(const QString &fileName);
+    // 重新加载被修改的文件并发布新的 SqlCatalog，在 watchThread 里调用
+    void reload();
+};
+
+/**
+ * 在线程池里加载一个 SQL 文件的任务，每个任务只写入自己的 LoadResult，不需要加锁。
+ */
+class SqlUtil::Private::LoadTask : public QRunnable {
+public:
+    LoadTask(const QString &fileName, const QHash<QString, SqlFile> &bundledFiles, LoadResult *result)
+        : fileName(fileName), bundledFiles(bundledFiles), result(result) {}
 
-protected:
-    bool startElement(const QString& namespaceURI, const QString& localName, const QString& qName, const QXmlAttributes& atts) Q_DECL_OVERRIDE;
-    bool endElement(const QString& namespaceURI, const QString& localName, const QString& qName) Q_DECL_OVERRIDE;
-    bool characters(const QString& ch) Q_DECL_OVERRIDE;
-    bool fatalError(const QXmlParseException& exception) Q_DECL_OVERRIDE;
+    void run() Q_DECL_OVERRIDE {
+        SqlUtil::Private::loadFile(fileName, bundledFiles, result);
+    }
 
 private:
-    QHash<QString, QString> sqls;
-    QHash<QString, QString> defines;
-    QString sqlNameSpace;
-    QString currentText;
-    QString currentSqlId;
-    QString currentDefineId;
-    QString currentIncludedDefineId;
+    QString fileName;
+    const QHash<QString, SqlFile> &bundledFiles;
+    LoadResult *result;
 };
 
-SqlUtil::Private::Private()
+/**
+ * 1. 读取 SQL 包，没有配置 database.sql_bundle 时不使用
+ * 2. 在线程池里同时读取 sql_files 里的文件，内容的 SHA-1 和 SQL 包里记录的相同时直接使用包里的语句，否则解析 XML，
+ *    每个文件的结果分开保存
+ * 3. 所有文件加载完后按 sql_files 的顺序合并，所以重复的 id 总是后面的文件覆盖前面的，和加载的快慢无关
+ * 4. 有文件被重新解析时重新生成 SQL 包
+ * 5. 开启了 database.sql_hot_reload 时监视 SQL 文件
+ */
+SqlUtil::Private::Private() : watchThread(NULL), watcher(NULL), reloadTimer(NULL)
 {
     //读取配置文件中配置项：sql_files
-    QStringList sqlFiles = Singleton<Config>::getInstance().getDatabaseSqlFiles();
-    if (!sqlFiles.isEmpty()) {
-        for (QString fileName : sqlFiles) {
-            qDebug() << QString("Loading SQL file：%1").arg(fileName);
-
-            //解析配置文件
-            QFile file(fileName);
-            QXmlInputSource inputSource(&file);
-            QXmlSimpleReader reader;
-            reader.setContentHandler(this);
-            reader.setErrorHandler(this);
-            reader.parse(inputSource);
-
-            this->defines.clear();
-        }
-    } else {
+    Config &config = Singleton<Config>::getInstance();
+    sqlFiles = config.getDatabaseSqlFiles();
+    bundleFile = config.getDatabaseSqlBundle();
+    if (sqlFiles.isEmpty()) {
         qDebug() << "Cannot find sql_files in app.ini";
+        publish(SqlCatalogPtr(new SqlCatalog));
+        return;
+    }
+
+    QHash<QString, SqlFile> bundledFiles = bundleFile.isEmpty() ? QHash<QString, SqlFile>() : SqlBundle::read(bundleFile);
+    QVector<LoadResult> results(sqlFiles.size());
+
+    if (sqlFiles.size() == 1) {
+        loadFile(sqlFiles.first(), bundledFiles, &results[0]);
+    } else {
+        QThreadPool loadThreads;
+        loadThreads.setMaxThreadCount(qMin(QThread::idealThreadCount(), sqlFiles.size()));
+        for (int i = 0; i < sqlFiles.size(); ++i) {
+            loadThreads.start(new LoadTask(sqlFiles.at(i), bundledFiles, &results[i]));
+        }
+        loadThreads.waitForDone();
+    }
+
+    bool bundleChanged = bundledFiles.size() != sqlFiles.size();
+    QVector<SqlFile> files(sqlFiles.size());
+    for (int i = 0; i < results.size(); ++i) {
+        files[i] = results.at(i).file;
+        files[i].fileName = sqlFiles.at(i);
+        bundleChanged = bundleChanged || !results.at(i).opened || results.at(i).parsed;
+    }
+
+    SqlCatalogPtr loaded(buildCatalog(files));
+    applyChanges(NULL, loaded.data());
+    publish(loaded);
+
+    if (!bundleFile.isEmpty() && bundleChanged) {
+        SqlBundle::write(bundleFile, files.toList());
+    }
+
+    if (config.isDatabaseSqlHotReload()) {
+        startWatching();
     }
 }
 
-QString SqlUtil::Private::buildKey(const QString &sqlNameSpace, const QString &sqlId)
+SqlUtil::Private::~Private()
 {
-    return sqlNameSpace + "::" + sqlId;
+    stopWatching();
 }
 
-QHash<QString, QString> SqlUtil::Private::getSqls() const
+SqlCatalogPtr SqlUtil::Private::current() const
 {
-    return this->sqls;
+    QReadLocker locker(&catalogLock);
+    return catalog;
 }
 
-/**
- * 1. 取得 SQL 得 xml 文档中得 namespace, sql id, include 的 defineId, include 的 id
- * 2. 如果是 <sql> 标签，清空 currentText
- * 3. 如果是 <define> 标签，清空 currentText
- * @brief 参数都是解析 xml 之后得到的
- * @param namespaceUri
- * @param localName
- * @param qName 标签类型
- * @param attributes 属性
- * @return
- */
-bool SqlUtil::Private::startElement(const QString &namespaceURI, const QString &localName, const QString &qName, const QXmlAttributes &atts)
-{
-    Q_UNUSED(namespaceURI);
-    Q_UNUSED(localName);
-    
-    if (SQL_TAGNAME_SQLS == qName) {
-        this->sqlNameSpace = atts.value(SQL_NAMESPACE);
-    } else if (SQL_TAGNAME_DEFINE == qName) {
-        this->currentDefineId = atts.value(SQL_ID);
-        //置空
-        this->currentText = "";
-    } else if (SQL_TAGNAME_SQL == qName) {
-        this->currentSqlId = atts.value(SQL_ID);
-        //置空
-        this->currentText = "";
-    } else if (SQL_TAGNAME_INCLUDE == qName) {
-        this->currentIncludedDefineId = atts.value(SQL_INCLUDE_DEFINE_ID);
-    }
-    return true;
+void SqlUtil::Private::publish(const SqlCatalogPtr &newCatalog)
+{
+    QWriteLocker locker(&catalogLock);
+    catalog = newCatalog;
+}
+
+void SqlUtil::Private::loadFile(const QString &fileName, const QHash<QString, SqlFile> &bundledFiles, LoadResult *result)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qDebug() << QString("Cannot open SQL file：%1").arg(fileName) << file.errorString();
+        return;
+    }
+    QByteArray content = file.readAll();
+    result->opened = true;
+
+    result->file = bundledFiles.value(fileName);
+    if (!result->file.valid || result->file.hash != SqlFileParser::hash(content)) {
+        qDebug() << QString("Loading SQL file：%1").arg(fileName);
+        //解析配置文件
+        result->file = SqlFile();
+        SqlFileParser::parse(fileName, content, &result->file);
+        result->parsed = true;
+    }
+}
+
+SqlCatalog *SqlUtil::Private::buildCatalog(const QVector<SqlFile> &files)
+{
+    SqlCatalog *result = new SqlCatalog;
+    result->files = files;
+
+    // 已经定义的语句所在的文件，用来检查重复的 id
+    QHash<QString, QString> definedIn;
+    for (const SqlFile &file : files) {
+        for (const SqlStatementPtr &statement : file.statements) {
+            QString previousFile = definedIn.value(statement->getStatementId());
+            if (!previousFile.isNull()) {
+                qDebug() << QString("Duplicate SQL id %1 in %2, overrides the one in %3")
+                            .arg(statement->getStatementId()).arg(file.fileName).arg(previousFile);
+            }
+            definedIn.insert(statement->getStatementId(), file.fileName);
+
+            //按句柄的下标保存，之后用句柄取得语句时不需要拼接 key 和计算 hash
+            StatementHandle handle(statement->getNameSpace(), statement->getId());
+            if (handle.getIndex() >= result->statements.size()) {
+                result->statements.resize(handle.getIndex() + 1);
+            }
+            result->statements[handle.getIndex()] = statement;
+            if (!statement->isDynamic()) {
+                result->statementIds.insert(statement->getSql(), statement->getStatementId());
+            }
+        }
+    }
+    return result;
+}
+
+bool SqlUtil::Private::isModified(const SqlStatementPtr &a, const SqlStatementPtr &b)
+{
+    if (a.isNull() || b.isNull()) {
+        return a.isNull() != b.isNull();
+    }
+    if (a->getSql() != b->getSql() || a->isCache() != b->isCache()
+            || a->getTtl() != b->getTtl() || a->getTables() != b->getTables() || a->isDynamic() != b->isDynamic()) {
+        return true;
+    }
+    return a->isDynamic() && templateBytes(a) != templateBytes(b);
 }
+
+QByteArray SqlUtil::Private::templateBytes(const SqlStatementPtr &statement)
+{
+    QByteArray bytes;
+    QDataStream out(&bytes, QIODevice::WriteOnly);
+    statement->getTemplate()->write(out);
+    return bytes;
+}
+
 /**
- * 1. 如果是 <sql> 标签，则插入 sqls
- * 2. 如果是 <include> 标签，则从 defines 里取其内容加入 sql
- * 3. 如果是 <define> 标签，则存入 defines
- * @param namespaceURI
- * @param localName
- * @param qName 标签类型
- * @return
+ * 只处理内容或者属性改变了的静态语句:
+ * 1. 旧的 SQL 不再使用时，从 QueryCache 注销 (缓存的结果不会再被取出)，并从所有连接的 prepare 缓存删除
+ * 2. 新的语句有 cache 或者 tables 属性时注册到 QueryCache
+ * 动态的语句每次渲染出的 SQL 可能不同，不注册到 QueryCache，旧模板渲染的 SQL 不再使用后由 prepare 缓存自己淘汰。
  */
-bool SqlUtil::Private::endElement(const QString &namespaceURI, const QString &localName, const QString &qName)
-{
-    Q_UNUSED(namespaceURI);
-    Q_UNUSED(localName);
-
-    if (SQL_TAGNAME_DEFINE == qName) {
-        this->defines.insert(buildKey(this->sqlNameSpace, this->currentDefineId), currentText.simplified());
-    } else if (SQL_TAGNAME_SQL == qName) {
-        this->sqls.insert(buildKey(this->sqlNameSpace, this->currentSqlId), currentText.simplified());
-        //重置
-        currentText = "";
-    } else if (SQL_TAGNAME_INCLUDE == qName) {
-        QString defineKey = buildKey(this->sqlNameSpace, this->currentIncludedDefineId);
-        QString defineValue = this->defines.value(defineKey);
-        if (!defineValue.isEmpty()) {
-            //将定义的片段拼接进 sql
-            currentText += defineValue;
-        } else {
-            qDebug() << "Cannot find define：" << defineKey;
+void SqlUtil::Private::applyChanges(const SqlCatalog *oldCatalog, const SqlCatalog *newCatalog)
+{
+    QueryCache &queryCache = Singleton<QueryCache>::getInstance();
+    QStringList evicted;
+    int size = qMax(oldCatalog != NULL ? oldCatalog->statements.size() : 0, newCatalog->statements.size());
+
+    for (int i = 0; i < size; ++i) {
+        SqlStatementPtr oldStatement = oldCatalog != NULL ? oldCatalog->statements.value(i) : SqlStatementPtr();
+        SqlStatementPtr newStatement = newCatalog->statements.value(i);
+        if (!isModified(oldStatement, newStatement)) {
+            continue;
+        }
+
+        // 相同的 SQL 可能还被其他 id 使用
+        if (!oldStatement.isNull() && !oldStatement->isDynamic() && !newCatalog->statementIds.contains(oldStatement->getSql())) {
+            queryCache.unregisterStatement(oldStatement->getSql());
+            evicted << oldStatement->getSql();
+        }
+        //有 cache 或者 tables 属性时注册到 DbUtil 的查询结果缓存
+        if (!newStatement.isNull() && !newStatement->isDynamic()
+                && (newStatement->isCache() || !newStatement->getTables().isEmpty())) {
+            queryCache.registerStatement(newStatement->getSql(), newStatement->isCache(),
+                                         newStatement->getTtl(), newStatement->getTables());
+        }
+        if (oldCatalog != NULL) {
+            qDebug() << QString("SQL %1 changed").arg(!newStatement.isNull() ? newStatement->getStatementId()
+                                                                             : oldStatement->getStatementId());
         }
     }
-    return true;
+
+    StatementCache::evictEverywhere(evicted);
 }
+
+void SqlUtil::Private::recordRendered(const QString &sql, const QString &statementId)
+{
+    {
+        // 大多数时候已经记录过了，只需要读锁
+        QReadLocker locker(&renderedLock);
+        if (renderedIds.contains(sql) || renderedIds.size() >= MAX_RENDERED_SQLS) {
+            return;
+        }
+    }
+    QWriteLocker locker(&renderedLock);
+    if (renderedIds.size() < MAX_RENDERED_SQLS) {
+        renderedIds.insert(sql, statementId);
+    }
+}
+
 /**
- * @brief 取出标签内的内容，拼接sql
- * @param ch 标签内的内容
- * @return
+ * QFileSystemWatcher 需要事件循环，所以在单独的线程 watchThread 里监视文件，
+ * 重新加载也在这个线程里进行，不会影响使用 SqlUtil 的线程。
  */
-bool SqlUtil::Private::characters(const QString &ch)
+void SqlUtil::Private::startWatching()
+{
+    watchThread = new QThread();
+    watchThread->setObjectName("SqlFileWatcher");
+
+    watcher = new QFileSystemWatcher();
+    watcher->addPaths(sqlFiles);
+    reloadTimer = new QTimer();
+    reloadTimer->setSingleShot(true);
+    reloadTimer->setInterval(RELOAD_DELAY);
+
+    // 第三个参数是接收者，lambda 在它所属的线程，也就是 watchThread 里执行
+    QObject::connect(watcher, &QFileSystemWatcher::fileChanged, watcher, [this](const QString &fileName) {
+        fileChanged(fileName);
+    });
+    QObject::connect(reloadTimer, &QTimer::timeout, reloadTimer, [this]() {
+        reload();
+    });
+
+    watcher->moveToThread(watchThread);
+    reloadTimer->moveToThread(watchThread);
+    watchThread->start(QThread::LowPriority);
+}
+
+void SqlUtil::Private::stopWatching()
 {
-    currentText += ch;
-    return true;
+    if (watchThread == NULL) {
+        return;
+    }
+
+    watchThread->quit();
+    watchThread->wait();
+    // 线程已经结束，可以在这里删除属于它的对象
+    delete watcher;
+    delete reloadTimer;
+    delete watchThread;
+    watcher = NULL;
+    reloadTimer = NULL;
+    watchThread = NULL;
 }
 
-bool SqlUtil::Private::fatalError(const QXmlParseException &exception)
+void SqlUtil::Private::fileChanged(const QString &fileName)
 {
-    qDebug() << QString("Parse error at line %1, column %2, message：%3")
-                .arg(exception.lineNumber())
-                .arg(exception.columnNumber())
-                .arg(exception.message());
-    return false;
+    changedFiles.insert(fileName);
+    reloadTimer->start();
 }
 
+void SqlUtil::Private::reload()
+{
+    // 有的编辑器保存时先删除再创建文件，QFileSystemWatcher 不再监视它，需要重新加入
+    for (const QString &fileName : sqlFiles) {
+        if (!watcher->files().contains(fileName) && QFile::exists(fileName)) {
+            watcher->addPath(fileName);
+        }
+    }
 
+    SqlCatalogPtr oldCatalog = current();
+    QVector<SqlFile> files = oldCatalog->files;
+    bool changed = false;
+
+    for (const QString &fileName : changedFiles) {
+        int index = sqlFiles.indexOf(fileName);
+        if (index < 0) {
+            continue;
+        }
+
+        LoadResult result;
+        loadFile(fileName, QHash<QString, SqlFile>(), &result);
+        if (!result.opened) {
+            // 可能正在保存，文件创建后还会收到通知
+            continue;
+        }
+        if (!result.file.valid) {
+            qDebug() << QString("Keep the previous SQL of %1 because it has errors").arg(fileName);
+            continue;
+        }
+        if (result.file.hash != files.at(index).hash) {
+            files[index] = result.file;
+            changed = true;
+        }
+    }
+    changedFiles.clear();
+
+    if (!changed) {
+        return;
+    }
+
+    // 发布新的 SqlCatalog，之后读取的线程都使用新的语句
+    // oldCatalog 的最后一个共享指针释放时删除它，还在读取它的线程不受影响
+    SqlCatalogPtr newCatalog(buildCatalog(files));
+    publish(newCatalog);
+    applyChanges(oldCatalog.data(), newCatalog.data());
+    // 修改后的模板渲染出的 SQL 可能不同，重新记录
+    {
+        QWriteLocker locker(&renderedLock);
+        renderedIds.clear();
+    }
+
+    if (!bundleFile.isEmpty()) {
+        SqlBundle::write(bundleFile, files.toList());
+    }
+}
 
 SqlUtil::SqlUtil() : d(new SqlUtil::Private)
 {
@@ -178,13 +437,74 @@ SqlUtil::~SqlUtil()
     d = NULL;
 }
 
+void SqlUtil::preload()
+{
+    // 第一次取得单例时在构造函数里加载
+    Singleton<SqlUtil>::getInstance();
+}
+
+void SqlUtil::release()
+{
+    d->stopWatching();
+}
+
+QString SqlUtil::getStatementId(const QString &sql) const
+{
+    QString id = d->current()->statementIds.value(sql);
+    if (!id.isEmpty()) {
+        return id;
+    }
+    QReadLocker locker(&d->renderedLock);
+    return d->renderedIds.value(sql);
+}
+
 QString SqlUtil::getSql(const QString &sqlNameSpace, const QString &sqlId) const
 {
-    QString sql = d->getSqls().value(d->buildKey(sqlNameSpace, sqlId));
-    if (sql.isEmpty()) {
+    StatementHandle handle = StatementHandle::find(sqlNameSpace, sqlId);
+    if (!handle.isValid()) {
         qDebug() << QString("Cannot find SQL for %1::%2").arg(sqlNameSpace).arg(sqlId);
+        return QString();
     }
-    return sql;
+    return getSql(handle);
+}
+
+QString SqlUtil::getSql(const StatementHandle &handle) const
+{
+    SqlCatalogPtr catalog = d->current();
+    int index = handle.getIndex();
+    if (index < 0 || index >= catalog->statements.size() || catalog->statements.at(index).isNull()) {
+        qDebug() << QString("Cannot find SQL for %1").arg(handle.getStatementId());
+        return QString();
+    }
+    const SqlStatementPtr &statement = catalog->statements.at(index);
+    if (statement->isDynamic()) {
+        // 不传参数时所有的 <if> 都不成立，例如 <where> 整个被删掉，执行的范围会比预期的大，所以不渲染
+        qDebug() << QString("SQL %1 has dynamic tags, use getSql(handle, params, &boundParams)").arg(handle.getStatementId());
+        return QString();
+    }
+    return statement->getSql();
 }
 
+QString SqlUtil::getSql(const StatementHandle &handle, const QVariantMap &params, QVariantMap *boundParams) const
+{
+    SqlCatalogPtr catalog = d->current();
+    int index = handle.getIndex();
+    if (index < 0 || index >= catalog->statements.size() || catalog->statements.at(index).isNull()) {
+        qDebug() << QString("Cannot find SQL for %1").arg(handle.getStatementId());
+        *boundParams = params;
+        return QString();
+    }
+    const SqlStatementPtr &statement = catalog->statements.at(index);
+    QString sql = statement->render(params, boundParams);
+    if (statement->isDynamic() && !sql.isEmpty()) {
+        d->recordRendered(sql, statement->getStatementId());
+    }
+    return sql;
+}
 
+SqlStatementPtr SqlUtil::getStatement(const StatementHandle &handle) const
+{
+    SqlCatalogPtr catalog = d->current();
+    int index = handle.getIndex();
+    return index >= 0 && index < catalog->statements.size() ? catalog->statements.at(index) : SqlStatementPtr();
+}
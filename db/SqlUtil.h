@@ -2,21 +2,30 @@
 #define SQLUTIL_H
 
 #include "util/Singleton.h"
+#include "db/SqlStatement.h"
 
-class QString;
+#include <QString>
+#include <QVariantMap>
 
 /**
 SQL 文件的定义
 1. <sqls> 必须有 namespace
 2. [<define>]*: <define> 必须在 <sql> 前定义，必须有 id 属性才有意义，否则不能被引用
 3. [<sql>]*: <sql> 必须有 id 属性才有意义，<sql> 里可以用 <include defineId="define_id"> 引用 <define> 的内容
+4. <sql> 可选的属性 cache="true" ttl="毫秒数" tables="表1,表2"，缓存查询的结果，cache 必须和 tables 一起使用，参考 QueryCache.h；
+   写语句的 tables 属性指定它修改的表，执行后这些表的缓存失效
+5. 分页查询的 <sql> 用 {keyset} 表示翻页的条件，:limit 表示每页的行数，由 DbUtil::selectPage() 执行，如
+   <sql id="findPage">SELECT id, username FROM user WHERE {keyset} ORDER BY id LIMIT :limit</sql>
+6. <sql> 里可以使用动态标签 <if test>, <where>, <set>, <choose>/<when>/<otherwise>, <foreach>，加载时编译为模板，
+   用 getSql(handle, params, &boundParams) 渲染，参考 SqlTemplate.h；值都通过命名参数绑定，不要用 %1 拼接到 SQL 里。
+   cache 属性只对没有动态标签的语句有效
 
 SQL 文件定义 Demo:
 <sqls namespace="User">
     <define id="fields">id, username, password, email, mobile</define>
 
-    <sql id="findByUserId">
-        SELECT <include defineId="fields"/> FROM user WHERE id=%1
+    <sql id="findUserById">
+        SELECT <include defineId="fields"/> FROM user WHERE id=:id
     </sql>
 
     <sql id="findAll">
@@ -33,17 +42,39 @@ SQL 文件定义 Demo:
             email=:email, mobile=:mobile
         WHERE id=:id
     </sql>
+
+    <sql id="findUsers">
+        SELECT <include defineId="fields"/> FROM user
+        <where>
+            <if test="username != null and username != ''">AND username=:username</if>
+            <if test="ids != null and ids.size > 0">
+                AND id IN <foreach collection="ids" item="id" open="(" separator="," close=")">:id</foreach>
+            </if>
+        </where>
+    </sql>
 </sqls>
 
 */
 
 /**
  * 用于加载 SQL 语句，用法.
- * Sqls::getSql("User", "selectById");
+ * Singleton<SqlUtil>::getInstance().getSql("User", "selectById");
+ *
+ * 频繁执行的语句使用 StatementHandle，只在创建句柄时查找一次，之后取得语句只是访问数组:
+ * static const StatementHandle SQL_SELECT_BY_ID("Product", "selectById");
+ * Singleton<SqlUtil>::getInstance().getSql(SQL_SELECT_BY_ID);
  *
  * SQL 文件的路径定义在 app.ini 的 [Database] 下的 sql_files，可以指定多个 SQL 文件，
  * 路径可以是绝对路径，也可以是相对与可执行文件的路径，如
  * sql_files = resources/sql/user.sql, resources/sql/product.sql
+ *
+ * 配置了 database.sql_bundle 时，解析后的语句保存到预编译的 SQL 包，下次启动时 SQL 文件没有修改就不再解析，
+ * 参考 SqlBundle.h
+ *
+ * 开启了 database.sql_hot_reload 时监视 SQL 文件，文件修改后在后台线程重新解析，原子地替换所有的语句，
+ * 读取语句只在复制当前语句集合的共享指针时加很短的读锁，正在执行的查询继续使用已经取得的旧的 SQL，
+ * 旧的语句集合在最后一个使用它的线程用完后释放；内容改变了的语句的查询结果缓存和
+ * prepare 的语句的缓存失效，没有改变的语句不受影响。SQL 文件有错误时保留修改前的语句。
  */
 
 class SqlUtil
@@ -51,8 +82,31 @@ class SqlUtil
     SINGLETON(SqlUtil)
 
 public:
-    // 取得 SQL 语句
+    /**
+     * 加载 SQL 文件，在 main() 里启动时调用，避免由第一个取得 SQL 的请求线程等待加载:
+     * SqlUtil::preload();
+     * SQL 文件在线程池里同时解析，返回时已经全部加载完。
+     */
+    static void preload();
+    // 停止监视 SQL 文件，程序结束前调用
+    void release();
+
+    // 取得 SQL 语句，有动态标签的语句返回空字符串，需要用 getSql(handle, params, &boundParams)
     QString getSql(const QString &sqlNameSpace, const QString &sqlId) const;
+    // 用句柄取得 SQL 语句，没有字符串拼接和 hash 计算，有动态标签的语句返回空字符串
+    QString getSql(const StatementHandle &handle) const;
+    /**
+     * @brief 用句柄取得 SQL 语句，有动态标签时根据参数渲染.
+     * @param handle 语句的句柄
+     * @param params 参数
+     * @param boundParams 保存执行 SQL 时绑定的参数，静态的语句和 params 相同
+     * @return SQL 语句
+     */
+    QString getSql(const StatementHandle &handle, const QVariantMap &params, QVariantMap *boundParams) const;
+    // 用句柄取得语句和它的属性，找不到时返回 NULL
+    SqlStatementPtr getStatement(const StatementHandle &handle) const;
+    // 取得 SQL 语句的 namespace::id，动态的语句用渲染出的 SQL 查找 (最多记录 1000 条)，不是 SQL 文件中定义的语句时返回空字符串
+    QString getStatementId(const QString &sql) const;
 
 private:
     class Private;
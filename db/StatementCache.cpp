@@ -0,0 +1,101 @@
+#include "StatementCache.h"
+
+#include <QList>
+#include <QMap>
+#include <QMutex>
+#include <QPair>
+#include <QVariant>
+#include <QSqlQuery>
+
+// 最多保留的 evictEverywhere() 的记录，落后更多的缓存直接清空
+static const int MAX_EVICTION_BATCHES = 64;
+
+// evictEverywhere() 调用的次数，take() 只读取它判断有没有需要删除的语句，不加锁
+static QAtomicInteger<quint64> evictionCount;
+// 保护 evictionBatches
+static QMutex evictionMutex;
+// 最近的 evictEverywhere() 的记录，first 是调用后的 evictionCount
+static QList<QPair<quint64, QStringList> > evictionBatches;
+
+StatementCache::StatementCache(int capacity, QAtomicInteger<qint64> *hits, QAtomicInteger<qint64> *misses)
+    : queries(capacity), hits(hits), misses(misses), evictionGeneration(evictionCount.loadAcquire())
+{
+}
+
+StatementCache::~StatementCache()
+{
+    clear();
+}
+
+QSqlQuery *StatementCache::take(const QString &sql)
+{
+    if (evictionGeneration != evictionCount.loadAcquire()) {
+        applyEvictions();
+    }
+
+    QSqlQuery *query = queries.take(sql);
+    if (query == NULL) {
+        misses->fetchAndAddRelaxed(1);
+        return NULL;
+    }
+    hits->fetchAndAddRelaxed(1);
+
+    // 上次绑定的参数会保留下来，这次没有传入的参数要重置为 NULL，和新建的 QSqlQuery 一样
+    QMap<QString, QVariant> boundValues = query->boundValues();
+    for (QMap<QString, QVariant>::const_iterator i = boundValues.constBegin(); i != boundValues.constEnd(); ++i) {
+        query->bindValue(i.key(), QVariant());
+    }
+    return query;
+}
+
+void StatementCache::put(const QString &sql, QSqlQuery *query)
+{
+    // 释放结果集，只保留 prepare 的语句
+    query->finish();
+    // 每条语句的开销为 1，超过容量时 QCache 删除最久没有使用的
+    queries.insert(sql, query, 1);
+}
+
+void StatementCache::clear()
+{
+    queries.clear();
+}
+
+int StatementCache::size() const
+{
+    return queries.size();
+}
+
+void StatementCache::evictEverywhere(const QStringList &sqls)
+{
+    if (sqls.isEmpty()) {
+        return;
+    }
+
+    QMutexLocker locker(&evictionMutex);
+    quint64 generation = evictionCount.load() + 1;
+    evictionBatches.append(qMakePair(generation, sqls));
+    while (evictionBatches.size() > MAX_EVICTION_BATCHES) {
+        evictionBatches.removeFirst();
+    }
+    evictionCount.storeRelease(generation);
+}
+
+void StatementCache::applyEvictions()
+{
+    QMutexLocker locker(&evictionMutex);
+    quint64 current = evictionCount.load();
+    if (evictionBatches.isEmpty() || evictionBatches.first().first > evictionGeneration + 1) {
+        // 记录已经被删除，不知道需要删除哪些语句
+        clear();
+    } else {
+        for (const QPair<quint64, QStringList> &batch : evictionBatches) {
+            if (batch.first > evictionGeneration) {
+                for (const QString &sql : batch.second) {
+                    queries.remove(sql);
+                }
+            }
+        }
+    }
+    evictionGeneration = current;
+}
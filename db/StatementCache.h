@@ -0,0 +1,55 @@
+#ifndef STATEMENTCACHE_H
+#define STATEMENTCACHE_H
+
+#include <QCache>
+#include <QString>
+#include <QAtomicInteger>
+#include <QStringList>
+
+class QSqlQuery;
+
+/**
+ * 一个连接上已经 prepare 过的 SQL 语句的缓存，key 是 SQL 语句，最多缓存 capacity 条，
+ * 超过时删除最久没有使用的。相同的 SQL 再次执行时复用缓存的 QSqlQuery，只需要重新绑定参数，
+ * 数据库不用再次解析 SQL 和生成执行计划（例如 MySQL 的服务端 prepare）。
+ *
+ * 每个连接有一个 StatementCache，连接池在建立连接的线程里创建它，关闭连接时在同一个线程里删除，
+ * 连接只会借给这个线程，所以 StatementCache 只在连接所属的线程里访问，不需要加锁。
+ * 连接重新打开前必须调用 clear()，缓存的 QSqlQuery 依赖于原来的连接。
+ *
+ * SQL 文件热加载后，修改前的语句用 evictEverywhere() 从所有连接的缓存删除: 只记录下来，
+ * 每个缓存在下次 take() 时才删除，所以仍然只有借到连接的线程访问缓存。
+ */
+class StatementCache
+{
+public:
+    // hits 和 misses 是连接池的统计，多个连接共享，所以使用原子变量
+    StatementCache(int capacity, QAtomicInteger<qint64> *hits, QAtomicInteger<qint64> *misses);
+    ~StatementCache();
+
+    // 取出 sql 对应的 QSqlQuery 并清空上次绑定的参数，调用者拥有它，用完后用 put() 放回；没有缓存时返回 NULL
+    QSqlQuery* take(const QString &sql);
+    // 放回执行成功的 QSqlQuery，由缓存拥有；执行失败的直接删除，不要放回
+    void put(const QString &sql, QSqlQuery *query);
+    // 删除所有缓存的 QSqlQuery
+    void clear();
+    // 缓存的语句数
+    int size() const;
+
+    // 从所有连接的缓存删除这些语句，可以在任何线程调用
+    static void evictEverywhere(const QStringList &sqls);
+
+private:
+    Q_DISABLE_COPY(StatementCache)
+
+    // 删除 evictEverywhere() 记录的语句
+    void applyEvictions();
+
+    QCache<QString, QSqlQuery> queries;
+    QAtomicInteger<qint64> *hits;
+    QAtomicInteger<qint64> *misses;
+    // 已经处理过的 evictEverywhere() 的次数
+    quint64 evictionGeneration;
+};
+
+#endif // STATEMENTCACHE_H
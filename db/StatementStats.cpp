@@ -0,0 +1,264 @@
+#include "StatementStats.h"
+#include "db/SqlUtil.h"
+#include "util/Config.h"
+
+#include <QCache>
+#include <QHash>
+#include <QMutex>
+#include <QRegularExpression>
+#include <QStringList>
+#include <QThreadStorage>
+
+#include <algorithm>
+
+// 一条 SQL 在一个线程里的计数器
+struct StatementCounter {
+    qint64 calls;
+    qint64 errors;
+    qint64 rows;
+    LatencyHistogram::Snapshot latency;
+
+    StatementCounter() : calls(0), errors(0), rows(0) {}
+
+    void merge(const StatementCounter &other) {
+        calls += other.calls;
+        errors += other.errors;
+        rows += other.rows;
+        latency.merge(other.latency);
+    }
+};
+
+typedef QHash<QString, StatementCounter> CounterHash;
+
+// 每个计数器表最多记录的语句数，超过后新的语句合并到 OTHER_STATEMENTS，避免拼接了不同常量的 SQL 使内存无限增长
+static const int MAX_STATEMENTS = 1000;
+static const char *OTHER_STATEMENTS = "<other>";
+
+// 取得 key 的计数器，表已满并且没有这个 key 时返回 OTHER_STATEMENTS 的计数器
+static StatementCounter& counterOf(CounterHash *counters, const QString &key)
+{
+    CounterHash::iterator i = counters->find(key);
+    if (i != counters->end()) {
+        return i.value();
+    }
+    if (counters->size() >= MAX_STATEMENTS) {
+        return (*counters)[QString::fromLatin1(OTHER_STATEMENTS)];
+    }
+    return (*counters)[key];
+}
+
+static void mergeCounters(CounterHash *target, const CounterHash &source)
+{
+    for (CounterHash::const_iterator i = source.constBegin(); i != source.constEnd(); ++i) {
+        counterOf(target, i.key()).merge(i.value());
+    }
+}
+
+/*-----------------------------------------------------------------------------|
+ |                          d指针 的定义                                        |
+ |----------------------------------------------------------------------------*/
+class StatementStats::Private {
+public:
+    struct LocalStats;
+
+    bool enabled;
+
+    // 保护所有对象的 locals 和 LocalStats::owner，先于 LocalStats::mutex 加锁
+    static QMutex registryMutex;
+    // 当前线程的计数器，QThreadStorage 在线程结束时删除保存的指针
+    static QThreadStorage<LocalStats *> localStats;
+
+    // 以下成员在 registryMutex 内访问
+    QList<LocalStats *> locals;
+    // 已经结束的线程的计数器
+    CounterHash retired;
+
+    Private();
+    ~Private();
+
+    // 当前线程的计数器，第一次调用时创建
+    LocalStats* local();
+
+    // 把 SQL 转为统计的 key
+    static QString statementKey(const QString &sql);
+    // 当前线程里 SQL 对应的统计的 key，使用线程的缓存，相同的 SQL 只转换一次
+    static QString cachedKey(LocalStats *local, const QString &sql);
+};
+
+/**
+ * 一个线程的计数器，只有这个线程会修改它，mutex 只在合并统计时和其他线程竞争。
+ */
+struct StatementStats::Private::LocalStats {
+    QMutex mutex;
+    CounterHash counters;
+    StatementStats::Private *owner;
+    // SQL 到统计的 key 的缓存，只在这个线程里访问，不需要加锁，最多 MAX_STATEMENTS 条，超过时删除最久没有使用的
+    QCache<QString, QString> keys;
+
+    explicit LocalStats(StatementStats::Private *owner) : owner(owner), keys(MAX_STATEMENTS) {}
+    // 线程结束时计数器合并到 owner
+    ~LocalStats();
+};
+
+QMutex StatementStats::Private::registryMutex;
+QThreadStorage<StatementStats::Private::LocalStats *> StatementStats::Private::localStats;
+
+StatementStats::Private::LocalStats::~LocalStats()
+{
+    QMutexLocker locker(&registryMutex);
+    if (owner != NULL) {
+        owner->locals.removeOne(this);
+        mergeCounters(&owner->retired, counters);
+    }
+}
+
+StatementStats::Private::Private()
+{
+    enabled = Singleton<Config>::getInstance().isDatabaseStatementStats();
+}
+
+StatementStats::Private::~Private()
+{
+    // 还在运行的线程的计数器不再合并到这里
+    QMutexLocker locker(&registryMutex);
+    for (LocalStats *local : locals) {
+        local->owner = NULL;
+    }
+    locals.clear();
+}
+
+StatementStats::Private::LocalStats *StatementStats::Private::local()
+{
+    if (!localStats.hasLocalData()) {
+        LocalStats *local = new LocalStats(this);
+        {
+            QMutexLocker locker(&registryMutex);
+            locals.append(local);
+        }
+        localStats.setLocalData(local);
+    }
+    return localStats.localData();
+}
+
+QString StatementStats::Private::statementKey(const QString &sql)
+{
+    QString id = Singleton<SqlUtil>::getInstance().getStatementId(sql);
+    if (!id.isEmpty()) {
+        return id;
+    }
+
+    // 临时的 SQL 把字符串和数字常量替换为 ?
+    static const QRegularExpression literals("'(?:[^']|'')*'|\\b\\d+(?:\\.\\d+)?\\b");
+    QString normalized = sql;
+    normalized.replace(literals, "?");
+    return normalized.simplified();
+}
+
+QString StatementStats::Private::cachedKey(LocalStats *local, const QString &sql)
+{
+    QString *key = local->keys.object(sql);
+    if (key != NULL) {
+        return *key;
+    }
+    QString newKey = statementKey(sql);
+    local->keys.insert(sql, new QString(newKey));
+    return newKey;
+}
+
+/*-----------------------------------------------------------------------------|
+ |                            StatementStats 的定义                             |
+ |----------------------------------------------------------------------------*/
+
+StatementStats::StatementStats() : d(new StatementStats::Private)
+{
+}
+
+StatementStats::~StatementStats()
+{
+    delete d;
+    d = NULL;
+}
+
+bool StatementStats::isEnabled() const
+{
+    return d->enabled;
+}
+
+void StatementStats::record(const QString &sql, qint64 micros, int rows, bool error)
+{
+    if (!d->enabled) {
+        return;
+    }
+
+    // 在锁外把 SQL 转为 namespace::id 或者替换了常量的 SQL，只记录归并后的 key，
+    // 线程缓存了转换的结果，重复执行的 SQL 不再查找 SqlUtil 和替换常量
+    Private::LocalStats *local = d->local();
+    QString key = Private::cachedKey(local, sql);
+    QMutexLocker locker(&local->mutex);
+    StatementCounter &counter = counterOf(&local->counters, key);
+    ++counter.calls;
+    if (error) {
+        ++counter.errors;
+    }
+    if (rows > 0) {
+        counter.rows += rows;
+    }
+    counter.latency.record(micros);
+}
+
+QList<StatementStatistics> StatementStats::statistics() const
+{
+    // 合并所有线程的计数器，record() 时已经按语句归并了 key
+    CounterHash byStatement;
+    {
+        QMutexLocker locker(&Private::registryMutex);
+        byStatement = d->retired;
+        for (Private::LocalStats *local : d->locals) {
+            QMutexLocker localLocker(&local->mutex);
+            mergeCounters(&byStatement, local->counters);
+        }
+    }
+
+    QList<StatementStatistics> result;
+    for (CounterHash::const_iterator i = byStatement.constBegin(); i != byStatement.constEnd(); ++i) {
+        StatementStatistics stats;
+        stats.statement = i.key();
+        stats.calls = i.value().calls;
+        stats.errors = i.value().errors;
+        stats.rows = i.value().rows;
+        stats.latency = i.value().latency;
+        result.append(stats);
+    }
+    std::sort(result.begin(), result.end(), [](const StatementStatistics &a, const StatementStatistics &b) {
+        return a.latency.sum > b.latency.sum;
+    });
+    return result;
+}
+
+QString StatementStats::dump() const
+{
+    QStringList lines;
+    lines << "calls\terrors\trows\ttotal_ms\tmean_ms\tp99_ms\tmax_ms\tstatement";
+    for (const StatementStatistics &stats : statistics()) {
+        lines << QString("%1\t%2\t%3\t%4\t%5\t%6\t%7\t")
+                 .arg(stats.calls)
+                 .arg(stats.errors)
+                 .arg(stats.rows)
+                 .arg(stats.latency.sum / 1000.0, 0, 'f', 1)
+                 .arg(stats.latency.mean() / 1000.0, 0, 'f', 3)
+                 .arg(stats.latency.percentile(0.99) / 1000.0, 0, 'f', 3)
+                 .arg(stats.latency.max / 1000.0, 0, 'f', 3)
+                 + stats.statement;
+    }
+    return lines.join("\n");
+}
+
+void StatementStats::reset()
+{
+    QMutexLocker locker(&Private::registryMutex);
+    d->retired.clear();
+    for (Private::LocalStats *local : d->locals) {
+        QMutexLocker localLocker(&local->mutex);
+        local->counters.clear();
+    }
+}
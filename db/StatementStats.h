@@ -0,0 +1,67 @@
+#ifndef STATEMENTSTATS_H
+#define STATEMENTSTATS_H
+
+#include "util/Singleton.h"
+#include "db/LatencyHistogram.h"
+
+#include <QList>
+#include <QString>
+
+/**
+ * 一条语句汇总后的执行统计。
+ */
+struct StatementStatistics {
+    // SQL 文件中的 namespace::id，临时的 SQL 为把常量替换为 ? 后的 SQL，超过语句数上限的为 <other>
+    QString statement;
+    // 执行次数
+    qint64 calls;
+    // 出错的次数
+    qint64 errors;
+    // 查询的行数或者影响的行数之和
+    qint64 rows;
+    // 耗时的分布，单位是微秒，sum 为总耗时
+    LatencyHistogram::Snapshot latency;
+
+    StatementStatistics() : calls(0), errors(0), rows(0) {}
+};
+
+/**
+ * 按语句汇总 DbUtil 执行 SQL 的统计，类似 PostgreSQL 的 pg_stat_statements，用来找出占用数据库时间最多的语句。
+ *
+ * DbUtil 每执行一条 SQL 调用 record()，只更新当前线程自己的计数器，不和其他线程竞争。
+ * 记录时把 SQL 转为 namespace::id (SqlUtil 里定义的语句) 或者把常量替换为 ? 的 SQL
+ * (临时的语句，例如 WHERE id=1 和 WHERE id=2 合并为 WHERE id=?)，每个线程缓存最近 1000 条 SQL 转换的结果，
+ * 重复执行的 SQL 只查一次线程自己的缓存；
+ * 每个线程最多记录 1000 条不同的语句，超过的合并到 <other>，内存不会随拼接的 SQL 无限增长。
+ * 调用 statistics() 或 dump() 时才把所有线程的计数器合并，线程结束时它的计数器合并到汇总里，不会丢失。
+ *
+ * 由 database.statement_stats 开启，默认开启。
+ */
+class StatementStats
+{
+    SINGLETON(StatementStats)
+
+public:
+    bool isEnabled() const;
+    /**
+     * @brief 记录一次执行.
+     * @param sql sql语句
+     * @param micros 耗时，单位是微秒
+     * @param rows 查询的行数或者影响的行数，不知道时为 -1
+     * @param error 是否出错
+     */
+    void record(const QString &sql, qint64 micros, int rows, bool error);
+    // 合并所有线程的统计，按总耗时从大到小排序
+    QList<StatementStatistics> statistics() const;
+    // 统计的文本表格，每条语句一行
+    QString dump() const;
+    // 清空统计
+    void reset();
+
+private:
+    class Private;
+    friend class Private;
+    Private *d;
+};
+
+#endif // STATEMENTSTATS_H
@@ -0,0 +1,180 @@
+#include "Transaction.h"
+#include "db/ConnectionPool.h"
+#include "db/DataSourceManager.h"
+#include "db/QueryCache.h"
+
+#include <QDebug>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QThreadStorage>
+
+// 当前线程最内层的事务，QThreadStorage 保存指针时会在线程结束时 delete，所以包装一下
+struct CurrentTransaction {
+    Transaction *transaction;
+
+    CurrentTransaction() : transaction(NULL) {}
+};
+
+static QThreadStorage<CurrentTransaction> currentTransaction;
+
+Transaction::Transaction() : statements(NULL), outer(current()), nestedCount(0), active(false)
+{
+    if (outer != NULL) {
+        // 嵌套的事务使用外层事务的连接，创建一个保存点
+        Transaction *root = outer;
+        while (root->outer != NULL) {
+            root = root->outer;
+        }
+        db = outer->db;
+        statements = outer->statements;
+        savepointName = QString("dbutil_savepoint_%1").arg(++root->nestedCount);
+        active = execute("SAVEPOINT " + savepointName);
+    } else {
+        connection = Singleton<DataSourceManager>::getInstance().poolFor(DataSourceManager::WriteAccess).borrowConnection();
+        db = connection.database();
+        statements = connection.statementCache();
+        active = connection.isValid() && db.transaction();
+        if (!active) {
+            qDebug() << "Begin transaction error:" << db.lastError().text();
+            connection.release();
+        }
+    }
+
+    if (active) {
+        currentTransaction.localData().transaction = this;
+    }
+}
+
+Transaction::~Transaction()
+{
+    if (!active) {
+        return;
+    }
+
+    if (current() != this) {
+        // 没有按创建的相反顺序析构，内层的事务还没有结束。内层的修改随本事务一起回滚，
+        // 先结束它们再回滚，否则 rollback() 失败，最外层的连接会带着没有结束的事务回到连接池
+        qDebug() << "Transaction destroyed before its nested transactions, rolling them back together";
+        for (Transaction *inner = current(); inner != NULL && inner != this; inner = inner->outer) {
+            inner->active = false;
+            inner->statements = NULL;
+            inner->db = QSqlDatabase();
+        }
+        currentTransaction.localData().transaction = this;
+    }
+    rollback();
+}
+
+bool Transaction::isActive() const
+{
+    return active;
+}
+
+bool Transaction::commit()
+{
+    if (!active || current() != this) {
+        qDebug() << "Commit error: transaction is not active or nested transactions are not finished";
+        return false;
+    }
+
+    bool ok;
+    if (outer != NULL) {
+        ok = execute("RELEASE SAVEPOINT " + savepointName);
+    } else {
+        ok = db.commit();
+        if (!ok) {
+            qDebug() << "Commit transaction error:" << db.lastError().text();
+            db.rollback();
+        }
+    }
+    finish();
+    return ok;
+}
+
+bool Transaction::rollback()
+{
+    if (!active || current() != this) {
+        qDebug() << "Rollback error: transaction is not active or nested transactions are not finished";
+        return false;
+    }
+
+    bool ok;
+    if (outer != NULL) {
+        // 回滚到保存点后再释放它，外层事务继续
+        ok = execute("ROLLBACK TO SAVEPOINT " + savepointName);
+        execute("RELEASE SAVEPOINT " + savepointName);
+    } else {
+        ok = db.rollback();
+    }
+    finish();
+    return ok;
+}
+
+bool Transaction::savepoint(const QString &name)
+{
+    return active && execute("SAVEPOINT " + name);
+}
+
+bool Transaction::rollbackToSavepoint(const QString &name)
+{
+    return active && execute("ROLLBACK TO SAVEPOINT " + name);
+}
+
+bool Transaction::releaseSavepoint(const QString &name)
+{
+    return active && execute("RELEASE SAVEPOINT " + name);
+}
+
+QSqlDatabase Transaction::database() const
+{
+    return db;
+}
+
+StatementCache *Transaction::statementCache() const
+{
+    return statements;
+}
+
+void Transaction::recordWrite(const QString &sql)
+{
+    Transaction *root = this;
+    while (root->outer != NULL) {
+        root = root->outer;
+    }
+    root->writes.insert(sql);
+}
+
+Transaction *Transaction::current()
+{
+    return currentTransaction.localData().transaction;
+}
+
+bool Transaction::execute(const QString &sql)
+{
+    QSqlQuery query(db);
+    if (!query.exec(sql)) {
+        qDebug() << "Transaction error:" << sql << query.lastError().text();
+        return false;
+    }
+    return true;
+}
+
+void Transaction::finish()
+{
+    active = false;
+    currentTransaction.localData().transaction = outer;
+
+    // 最外层的事务结束后归还连接，再使事务里修改的表的查询结果缓存失效。
+    // 回滚时也失效：事务进行中其他线程可能已经缓存了结果，失效只会多查询一次
+    if (outer == NULL) {
+        statements = NULL;
+        db = QSqlDatabase();
+        connection.release();
+
+        QueryCache &queryCache = Singleton<QueryCache>::getInstance();
+        for (const QString &sql : writes) {
+            queryCache.invalidate(sql);
+        }
+        writes.clear();
+    }
+}
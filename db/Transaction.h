@@ -0,0 +1,87 @@
+#ifndef TRANSACTION_H
+#define TRANSACTION_H
+
+#include "db/PooledConnection.h"
+
+#include <QSet>
+#include <QString>
+#include <QSqlDatabase>
+
+class StatementCache;
+
+/**
+ * 数据库事务，在作用域内当前线程的所有 DbUtil 操作都使用同一个连接并在这个事务里执行:
+ *     {
+ *         Transaction transaction;
+ *         DbUtil::insert(sql1, params1);
+ *         DbUtil::update(sql2, params2);
+ *         transaction.commit();
+ *     } // 没有 commit 时析构自动回滚
+ * 也可以使用 DbUtil::transaction() 传入要执行的函数。
+ *
+ * 创建时从主库的连接池借出一个连接并开始事务，结束 (commit 或 rollback) 时归还连接。
+ * 事务里的读操作也使用这个连接，可以读到事务里刚写入的数据。事务里的写操作在最外层的事务结束时
+ * 才使 QueryCache 里依赖被修改的表的缓存失效，提交前其他线程读到的旧数据不会被当作新的结果缓存。
+ *
+ * 可以嵌套: 当前线程已经在事务中时，新的 Transaction 不再借连接，而是在外层事务的连接上创建一个保存点，
+ * commit 释放保存点，rollback 回滚到保存点，只撤销内层的修改。也可以用 savepoint() 等函数手动管理保存点。
+ * 嵌套的事务必须按创建的相反顺序结束，放在各自的作用域里即可。外层的事务先析构时，
+ * 还没有结束的内层事务随它一起回滚并失效，连接不会带着没有结束的事务回到连接池。
+ *
+ * 事务只对创建它的线程有效，*Async 函数在工作线程里执行，不会使用这个事务。
+ */
+class Transaction
+{
+public:
+    Transaction();
+    ~Transaction();
+
+    // 是否已经开始并且还没有结束
+    bool isActive() const;
+    // 提交事务，嵌套时释放保存点，成功返回 true；失败时回滚
+    bool commit();
+    // 回滚事务，嵌套时回滚到保存点
+    bool rollback();
+
+    // 创建保存点
+    bool savepoint(const QString &name);
+    // 回滚到保存点，保存点之后的修改被撤销，事务继续
+    bool rollbackToSavepoint(const QString &name);
+    // 释放保存点
+    bool releaseSavepoint(const QString &name);
+
+    // 事务使用的连接
+    QSqlDatabase database() const;
+    // 事务使用的连接上 prepare 过的语句的缓存，可能为 NULL
+    StatementCache* statementCache() const;
+
+    // 记录事务里执行的写语句，最外层的事务结束 (提交或者回滚) 后依赖被修改的表的查询结果缓存才失效
+    void recordWrite(const QString &sql);
+
+    // 当前线程最内层的事务，不在事务中时返回 NULL
+    static Transaction* current();
+
+private:
+    Q_DISABLE_COPY(Transaction)
+
+    // 执行保存点等事务控制语句
+    bool execute(const QString &sql);
+    // 结束事务，从当前线程的事务栈中移除
+    void finish();
+
+    // 只有最外层的事务持有借出的连接
+    PooledConnection connection;
+    QSqlDatabase db;
+    StatementCache *statements;
+    // 外层的事务，最外层的为 NULL
+    Transaction *outer;
+    // 嵌套时对应的保存点的名字
+    QString savepointName;
+    // 最外层事务里已经创建的嵌套事务的数量，用于生成保存点的名字
+    int nestedCount;
+    // 最外层的事务里执行过的写语句，结束时使查询结果缓存失效
+    QSet<QString> writes;
+    bool active;
+};
+
+#endif // TRANSACTION_H
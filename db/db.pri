@@ -1,11 +1,42 @@
 SOURCES += \
     $$PWD/ConnectionPool.cpp \
+    $$PWD/PooledConnection.cpp \
+    $$PWD/LatencyHistogram.cpp \
+    $$PWD/DataSourceManager.cpp \
+    $$PWD/DbExecutor.cpp \
+    $$PWD/StatementCache.cpp \
+    $$PWD/ResultSet.cpp \
+    $$PWD/Transaction.cpp \
+    $$PWD/BulkWriter.cpp \
+    $$PWD/QueryCache.cpp \
+    $$PWD/SlowQueryLog.cpp \
+    $$PWD/StatementStats.cpp \
+    $$PWD/SqlTemplate.cpp \
+    $$PWD/SqlStatement.cpp \
+    $$PWD/SqlFileParser.cpp \
+    $$PWD/SqlBundle.cpp \
     $$PWD/SqlUtil.cpp \
     $$PWD/DbUtil.cpp
     
 
 HEADERS += \
     $$PWD/ConnectionPool.h \
+    $$PWD/PooledConnection.h \
+    $$PWD/LatencyHistogram.h \
+    $$PWD/DataSourceManager.h \
+    $$PWD/DbExecutor.h \
+    $$PWD/StatementCache.h \
+    $$PWD/ResultSet.h \
+    $$PWD/BeanMapper.h \
+    $$PWD/Transaction.h \
+    $$PWD/BulkWriter.h \
+    $$PWD/QueryCache.h \
+    $$PWD/SlowQueryLog.h \
+    $$PWD/StatementStats.h \
+    $$PWD/SqlTemplate.h \
+    $$PWD/SqlStatement.h \
+    $$PWD/SqlFileParser.h \
+    $$PWD/SqlBundle.h \
     $$PWD/SqlUtil.h \
     $$PWD/DbUtil.h
     
@@ -3,15 +3,13 @@
 #include "db/DbUtil.h"
 #include "demo/bean/User.h"
 
-#include <QCache>
-
 /**
  * <?xml version="1.0" encoding="UTF-8"?>
     <sqls namespace="User">
         <define id="fields">id, username, password, email, mobile</define>
 
-        <sql id="findByUserId">
-            SELECT <include defineId="fields"/> FROM user WHERE id=%1
+        <sql id="findUserById">
+            SELECT <include defineId="fields"/> FROM user WHERE id=:id
         </sql>
 
         <sql id="findAll">
@@ -33,69 +31,63 @@
 
 static const QString SQL_NAMESPACE_USER = "User";
 /*
- * 缓存基本策略：
- *
- * 单个对象缓存：key：就是对象id；value：就是对象
- * 多个对象缓存（比如分页查询）： key：就是“函数名+参数1+参数2+...”；value：就是“对象id集合”
- *
- * 1、更新策略：只更新单个对象缓存
- * 2、删除策略：只删除单个对象缓存
- * 3、查询策略：查询策略又分为单个对象查询和多个对象查询
- *  （1）单个对象查询：基本一致
- *  （2）多个对象查询：获取缓存，取出id集合，然后遍历id集合，再去单个对象缓存里去找：
- *                   a.若全部找到，则返回对象集合
- *                   b.若未找到全部，则说明有对象已被删除，删除该缓存，重新查询数据库，更新缓存，返回
- *
- * 备注：若是自己写的局部缓存，就按上述策略；若使用像redis这种全局缓存，则重点需要构建key：对象的全局唯一id:id
+ * 语句的句柄在静态初始化时创建，只查找一次，DAO 的方法里用句柄取得 SQL 不需要拼接 key 和计算 hash
+ */
+static const StatementHandle SQL_FIND_USER_BY_ID(SQL_NAMESPACE_USER, "findUserById");
+static const StatementHandle SQL_FIND_USERS(SQL_NAMESPACE_USER, "findUsers");
+static const StatementHandle SQL_FIND_ALL(SQL_NAMESPACE_USER, "findAll");
+static const StatementHandle SQL_FIND_PAGE(SQL_NAMESPACE_USER, "findPage");
+static const StatementHandle SQL_INSERT(SQL_NAMESPACE_USER, "insert");
+static const StatementHandle SQL_UPDATE(SQL_NAMESPACE_USER, "update");
+static const StatementHandle SQL_DELETE(SQL_NAMESPACE_USER, "delete");
+/*
+ * 查询结果由 DbUtil 的 QueryCache 缓存，在 user.sql 里给需要缓存的 <sql> 加上 cache 属性即可，
+ * insert, update 和 delete 修改 user 表后依赖它的缓存自动失效，DAO 里不需要自己维护缓存。
  */
-
-//在.h文件中定义了静态变量，在.cpp文件中使用，必须再次申明，否则报错
-QCache<QString, User> UserDao::userCache;
-QCache<QString, QList<int>> UserDao::usersCache;
 
 User UserDao::findUserById(int id)
 {
-    QString key = "id";
-    if (userCache.contains(key)) {
-        return *userCache.object(key);
-    } else {
-        User user = DbUtil::selectBean(mapToUser, getSql("findUserById").arg(id));
-        userCache.insert(key, &user);
-        return user;
+    // id 作为参数绑定，不同的 id 使用相同的 SQL，可以复用 prepare 的语句
+    QVariantMap params;
+    params["id"] = id;
+    return DbUtil::selectBean(userMapper(), getSql(SQL_FIND_USER_BY_ID), params);
+}
+
+QList<User> UserDao::findUsers(const QString &username, const QList<int> &ids)
+{
+    QVariantMap params;
+    if (!username.isEmpty()) {
+        params["username"] = username;
+    }
+    QVariantList idList;
+    for (int id : ids) {
+        idList << id;
     }
+    params["ids"] = idList;
+
+    // 根据参数渲染 <where>, <if> 和 <foreach>，boundParams 是需要绑定的参数
+    QVariantMap boundParams;
+    QString sql = Singleton<SqlUtil>::getInstance().getSql(SQL_FIND_USERS, params, &boundParams);
+    return DbUtil::selectBeans(userMapper(), sql, boundParams);
 }
 
-/**
- * 查询所有数据，基本思路：
- * 1、根据key获取id集合
- * 2、遍历id集合，判断缓存是否存在该id对应的对象，一旦没有，则中断循环，清空对象集合
- * 3、判断对象集合是否为空，非空则说明缓存中对应的对象都在，返回缓存中对象即可
- * 4、若此时程序还未终止，说明缓存中数据有问题，查询数据库，更新缓存
- */
 QList<User> UserDao::findAll()
 {
-    QString key = "findUserById";
+    return DbUtil::selectBeans(userMapper(), getSql(SQL_FIND_ALL));
+}
+
+QList<User> UserDao::findPage(const QString &cursor, int pageSize, QString *nextCursor)
+{
+    Page page = DbUtil::selectPage(getSql(SQL_FIND_PAGE), QStringList() << "id", cursor, pageSize);
+    *nextCursor = page.nextCursor;
+
     QList<User> users;
-    //QCache自动获得被插入对象的所有权，并在需要的时候自动释放他们来为新插入的对象腾出空间，所以不用担心内存泄漏的问题
-    //而且这里必须使用new,否则在该函数结束以后，集合变量就被删除了，导致缓存中的指针成为野指针！！！！！
-    QList<int> *ids = new QList<int>();
-    if (usersCache.contains(key)) {
-        for (int id : *usersCache.object(key)) {
-            if (!userCache.contains(QString::number(id))) {
-                users.clear();
-                break;
-            }
-            users.append(*userCache.object(QString::number(id)));
-        }
-        if (!users.isEmpty()) {
-            return users;
-        }
+    QVector<int> columns = userMapper().resolve(page.rows);
+    for (int row = 0; row < page.rows.rowCount(); ++row) {
+        User user;
+        userMapper().map(page.rows, row, columns, &user);
+        users.append(user);
     }
-    users = DbUtil::selectBeans(mapToUser, getSql("findAll"));
-    for (User user : users) {
-        ids->append(user.getId());
-    }
-    usersCache.insert(key, ids);
     return users;
 }
 
@@ -107,16 +99,7 @@ int UserDao::insert(User *user)
     params["password"] = user->getPassword();
     params["email"] = user->getEmail();
     params["mobile"] = user->getMobile();
-    int newId = DbUtil::insert(getSql("insert"), params);
-    //-1作为判断 User 是否为空的标志位
-    if (newId != -1) {
-        userCache.insert(QString::number(newId), user);
-        //因为新插入数据，所以需要更新数据集合（分页查询、全部查询），若不更新，则永远找不到新数据
-        //现在采用的策略是删除所有的集合缓存，后续有什么好的方法再改进吧
-        usersCache.clear();
-    }
-
-    return newId;
+    return DbUtil::insert(getSql(SQL_INSERT), params);
 }
 
 bool UserDao::update(User *user)
@@ -128,57 +111,36 @@ bool UserDao::update(User *user)
     params["password"] = user->getPassword();
     params["email"] = user->getEmail();
     params["mobile"] = user->getMobile();
-    bool result = DbUtil::update(getSql("update"), params);
-    if (result) {
-        //修改缓存
-        userCache.insert(QString::number(user->getId()), user);
-    }
-    return result;
+    return DbUtil::update(getSql(SQL_UPDATE), params);
 }
 
 bool UserDao::deleteUser(int id)
 {
-    //更新缓存
     QVariantMap params;
     params["id"] = id;
-    bool result = DbUtil::update(getSql("delete"), params);
-    if (result) {
-        userCache.remove(QString::number(id));
-    }
-    return result;
+    return DbUtil::update(getSql(SQL_DELETE), params);
 }
 
 /**
- * @brief 将 QVariantMap 对象转换成 User
- * @param rowMap 数据库查询到的结果转换成的 QVariantMap 对象
- * @return User
+ * @brief 查询结果的列到 User 的 setter 的映射，第一次调用时创建，没有的列保持 User 的默认值
+ * @return 列到 setter 的映射
  */
-User UserDao::mapToUser(const QVariantMap &rowMap)
+const BeanMapper<User> &UserDao::userMapper()
 {
-    User user;
-    user.setId(rowMap.value("id", -1).toInt());
-    user.setUsername(rowMap.value("username").toString());
-    user.setPassword(rowMap.value("password").toString());
-    user.setEmail(rowMap.value("email").toString());
-    user.setMobile(rowMap.value("mobile").toString());
-    return user;
+    static const BeanMapper<User> mapper = BeanMapper<User>()
+            .bind("id", &User::setId)
+            .bind("username", &User::setUsername)
+            .bind("password", &User::setPassword)
+            .bind("email", &User::setEmail)
+            .bind("mobile", &User::setMobile);
+    return mapper;
 }
 /**
  * @brief 从配置文件中取出sql
- * @param 函数名
+ * @param handle 语句的句柄
  * @return sql
  */
-QString UserDao::getSql(const QString &functionName)
+QString UserDao::getSql(const StatementHandle &handle)
 {
-    return Singleton<SqlUtil>::getInstance().getSql(SQL_NAMESPACE_USER, functionName);
+    return Singleton<SqlUtil>::getInstance().getSql(handle);
 }
-
-QString UserDao::buildKey(std::initializer_list<QString> params)
-{
-    QString key;
-    for (auto param : params) {
-        key += param + ":";
-    }
-    return key;
-}
-
@@ -7,31 +7,40 @@
 #include <QVariantMap>
 
 class User;
+class StatementHandle;
+template <typename T> class BeanMapper;
 
 class UserDao
 {
 public:
     static User findUserById(int id);
+    /**
+     * @brief 按条件查询，条件为空时忽略
+     * @param username 用户名
+     * @param ids id 的列表
+     * @return 满足所有条件的 User
+     */
+    static QList<User> findUsers(const QString &username, const QList<int> &ids);
     static QList<User> findAll();
+    /**
+     * @brief 按 id 分页查询
+     * @param cursor 上一页返回的游标，第一页为空
+     * @param pageSize 每页的记录数
+     * @param nextCursor 保存下一页的游标，没有下一页时为空
+     * @return 这一页的 User
+     */
+    static QList<User> findPage(const QString &cursor, int pageSize, QString *nextCursor);
     static int insert(User *user);
     static bool update(User *user);
     static bool deleteUser(int id);
 
 private:
     /**
-     * @brief 将 QVariantMap 对象转换成 User
-     * @param rowMap 数据库查询到的结果转换成的 QVariantMap 对象
-     * @return User
+     * @brief 查询结果的列到 User 的 setter 的映射
+     * @return 只创建一次的映射
      */
-    static User mapToUser(const QVariantMap &rowMap);
-    static QString getSql(const QString &functionName);
-    //根据函数名和参数构造缓存的key
-    static QString buildKey(std::initializer_list<QString> params);
-
-    //单条记录缓存，key:"id"，value:"User"
-    static QCache<QString, User> userCache;
-    //缓存多条记录，key:"方法名+参数"，value：id集合
-    static QCache<QString, QList<int>> usersCache;
+    static const BeanMapper<User>& userMapper();
+    static QString getSql(const StatementHandle &handle);
 };
 
 #endif // USERDAO_H
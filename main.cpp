@@ -2,7 +2,10 @@
 
 #include "db/SqlUtil.h"
 #include "db/DbUtil.h"
-#include "db/ConnectionPool.h"
+#include "db/DataSourceManager.h"
+#include "db/DbExecutor.h"
+#include "db/SlowQueryLog.h"
+#include "db/StatementStats.h"
 #include "demo/bean/User.h"
 #include "demo/dao/UserDao.h"
 
@@ -20,44 +23,52 @@ void testUpdate();
 int main(int argc, char *argv[])
 {
     QCoreApplication a(argc, argv);
+    // 启动时加载 SQL 文件，而不是在第一次使用时
+    SqlUtil::preload();
+    // 启动异步任务的工作线程，它们在自己的线程里预热连接池的 min_idle 个连接
+    Singleton<DbExecutor>::getInstance().start();
 //    useDbUtil();
 //    useSqlFromFile();
 //    useDao();
 //    testCache();
 //    testQCache();
     testUpdate();
-    //必须手动释放，否则程序会崩溃
-    Singleton<ConnectionPool>::getInstance().release();
+    qDebug().noquote() << Singleton<StatementStats>::getInstance().dump();
+    //必须手动释放，否则程序会崩溃，先停止异步任务的工作线程，再关闭连接池，然后写完慢查询日志，最后停止监视 SQL 文件
+    Singleton<DbExecutor>::getInstance().release();
+    Singleton<DataSourceManager>::getInstance().release();
+    Singleton<SlowQueryLog>::getInstance().release();
+    Singleton<SqlUtil>::getInstance().release();
     return a.exec();
 }
 
 void testUpdate() {
-    //必须是new出来的对象，否则 QCache 拿不到所有权，就无法自动删除该对象，导致内存泄漏
-    User *user = new User();
-    user->setId(87);
-    user->setUsername("Alice2");
-    user->setPassword("5666");
-    user->setEmail("23423@164.com");
-    user->setMobile("1234241234");
-    UserDao::update(user);
+    User user;
+    user.setId(87);
+    user.setUsername("Alice2");
+    user.setPassword("5666");
+    user.setEmail("23423@164.com");
+    user.setMobile("1234241234");
+    UserDao::update(&user);
 }
 void testCache() {
-    User *user1 = new User();
-    User *user2 = new User();
-    user1->setUsername("Alice");
-    user1->setPassword("123123");
-    user1->setEmail("23423@qq.com");
-    user1->setMobile("1234241234");
-
-    user2->setUsername("Bob");
-    user2->setPassword("4564654");
-    user2->setEmail("23423@163.com");
-    user2->setPassword("dfhfdhgdfgh");
-    user2->setMobile("54674576546");
-
-    UserDao::insert(user1);
-    UserDao::insert(user2);
+    User user1;
+    User user2;
+    user1.setUsername("Alice");
+    user1.setPassword("123123");
+    user1.setEmail("23423@qq.com");
+    user1.setMobile("1234241234");
+
+    user2.setUsername("Bob");
+    user2.setPassword("4564654");
+    user2.setEmail("23423@163.com");
+    user2.setPassword("dfhfdhgdfgh");
+    user2.setMobile("54674576546");
+
+    UserDao::insert(&user1);
+    UserDao::insert(&user2);
     int startTime = QTime::currentTime().second();
+    // findAll 的结果由 QueryCache 缓存，只有第一次查询数据库
     for (int i=0; i<1000; i++) {
         UserDao::findAll();
     }
@@ -98,10 +109,13 @@ void useDbUtil() {
 }
 
 void useSqlFromFile() {
-    // 读取 namespace 为 User 下，id 为 findByUserId 的 SQL 语句
-    qDebug() << Singleton<SqlUtil>::getInstance().getSql("User", "findByUserId");
-    qDebug() << Singleton<SqlUtil>::getInstance().getSql("User", "findByUserId-1"); // 找不到这条 SQL 语句会有提示
-    qDebug() << DbUtil::selectMap(Singleton<SqlUtil>::getInstance().getSql("User", "findByUserId").arg(2));
+    // 读取 namespace 为 User 下，id 为 findUserById 的 SQL 语句
+    qDebug() << Singleton<SqlUtil>::getInstance().getSql("User", "findUserById");
+    qDebug() << Singleton<SqlUtil>::getInstance().getSql("User", "findUserById-1"); // 找不到这条 SQL 语句会有提示
+
+    QVariantMap params;
+    params["id"] = 2;
+    qDebug() << DbUtil::selectMap(Singleton<SqlUtil>::getInstance().getSql("User", "findUserById"), params);
 }
 
 void useDao() {
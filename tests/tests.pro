@@ -0,0 +1,21 @@
+QT += core sql testlib
+QT -= gui
+
+CONFIG += c++11
+
+TARGET = tst_libdbutil
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+TEMPLATE = app
+
+# 源码里的 #include "db/..." 相对于项目的根目录
+INCLUDEPATH += $$PWD/..
+# 测试在这个目录下运行，读取 data/config.json
+DEFINES += TEST_DATA_DIR=\\\"$$PWD\\\"
+DEFINES += QT_DEPRECATED_WARNINGS
+
+SOURCES += tst_libdbutil.cpp
+
+include($$PWD/../util/util.pri)
+include($$PWD/../db/db.pri)
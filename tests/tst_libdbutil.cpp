@@ -0,0 +1,351 @@
+#include "db/BulkWriter.h"
+#include "db/ConnectionPool.h"
+#include "db/DbUtil.h"
+#include "db/PooledConnection.h"
+#include "db/QueryCache.h"
+#include "db/ResultSet.h"
+#include "db/SqlTemplate.h"
+#include "util/Config.h"
+
+#include <QtTest>
+#include <QDir>
+#include <QScopedPointer>
+#include <QSemaphore>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QThread>
+#include <QXmlStreamReader>
+
+// 测试用的 SQLite 内存数据库的连接名
+static const QString TEST_CONNECTION = "tst_libdbutil";
+
+/**
+ * 取得一个连接后一直持有，直到 release 被释放，用来占满连接池。
+ */
+class BorrowThread : public QThread
+{
+public:
+    BorrowThread(ConnectionPool *pool, QSemaphore *attempted, QSemaphore *release, QAtomicInt *borrowed, QAtomicInt *maxTotal)
+        : pool(pool), attempted(attempted), release(release), borrowed(borrowed), maxTotal(maxTotal) {}
+
+protected:
+    void run() Q_DECL_OVERRIDE {
+        PooledConnection connection = pool->borrowConnection();
+        if (connection.isValid()) {
+            borrowed->fetchAndAddOrdered(1);
+        }
+
+        // 记录见到的最大连接数
+        int total = pool->metrics().totalConnections;
+        int seen = maxTotal->load();
+        while (total > seen && !maxTotal->testAndSetOrdered(seen, total)) {
+            seen = maxTotal->load();
+        }
+
+        attempted->release();
+        if (connection.isValid()) {
+            release->acquire();
+        }
+    }
+
+private:
+    ConnectionPool *pool;
+    QSemaphore *attempted;
+    QSemaphore *release;
+    QAtomicInt *borrowed;
+    QAtomicInt *maxTotal;
+};
+
+class LibDbUtilTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void sqlTemplateRendersWhereAndForeach();
+    void sqlTemplateRendersSet();
+    void bulkWriterChunksByParameterLimit();
+    void bulkWriterHalvesChunksOverByteLimit();
+    void bulkWriterRejectsTooManyColumns();
+    void cursorRoundTrip();
+    void cursorRejectsInvalidInput();
+    void queryCacheInvalidatesWrittenTable();
+    void queryCacheClearsOnMultiTableWrite();
+    void queryCacheRequiresTables();
+    void poolNeverExceedsMaxConnectionCount();
+
+private:
+    // 解析 <sql> 元素为模板
+    static SqlTemplate* parseTemplate(const QString &xml);
+    // 一行 id=1, name=tom 的结果
+    static ResultSet sampleResult();
+};
+
+void LibDbUtilTest::initTestCase()
+{
+    // Config 读取当前目录下的 data/config.json
+    QVERIFY(QDir::setCurrent(TEST_DATA_DIR));
+
+    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", TEST_CONNECTION);
+    db.setDatabaseName(":memory:");
+    QVERIFY(db.open());
+}
+
+void LibDbUtilTest::cleanupTestCase()
+{
+    QSqlDatabase::database(TEST_CONNECTION).close();
+    QSqlDatabase::removeDatabase(TEST_CONNECTION);
+}
+
+SqlTemplate *LibDbUtilTest::parseTemplate(const QString &xml)
+{
+    QXmlStreamReader reader(xml);
+    reader.readNextStartElement();
+    return SqlTemplate::parse(&reader, "User", QHash<QString, QString>());
+}
+
+ResultSet LibDbUtilTest::sampleResult()
+{
+    QSqlQuery query(QSqlDatabase::database(TEST_CONNECTION));
+    query.setForwardOnly(true);
+    query.exec("SELECT 1 AS id, 'tom' AS name");
+    return ResultSet::fromQuery(&query);
+}
+
+void LibDbUtilTest::sqlTemplateRendersWhereAndForeach()
+{
+    QScopedPointer<SqlTemplate> sqlTemplate(parseTemplate(
+        "<sql id=\"findUsers\">SELECT id FROM user"
+        "  <where>"
+        "    <if test=\"name != null and name != ''\">AND name=:name</if>"
+        "    <if test=\"ids != null and ids.size > 0\">"
+        "      AND id IN <foreach collection=\"ids\" item=\"id\" open=\"(\" separator=\",\" close=\")\">:id</foreach>"
+        "    </if>"
+        "  </where>"
+        "</sql>"));
+    QVERIFY(sqlTemplate->isDynamic());
+
+    // 没有参数时所有的条件都不成立，<where> 整个删掉
+    QVariantMap bound;
+    QCOMPARE(sqlTemplate->render(QVariantMap(), &bound), QString("SELECT id FROM user"));
+    QVERIFY(bound.isEmpty());
+
+    QVariantMap params;
+    params["name"] = "tom";
+    params["ids"] = QVariantList() << 1 << 2;
+    bound.clear();
+    QCOMPARE(sqlTemplate->render(params, &bound),
+             QString("SELECT id FROM user WHERE name=:name AND id IN (:__id_0,:__id_1)"));
+    QCOMPARE(bound.size(), 3);
+    QCOMPARE(bound.value("name").toString(), QString("tom"));
+    QCOMPARE(bound.value("__id_0").toInt(), 1);
+    QCOMPARE(bound.value("__id_1").toInt(), 2);
+
+    // 开头的 AND 被 <where> 去掉
+    params.remove("name");
+    bound.clear();
+    QCOMPARE(sqlTemplate->render(params, &bound), QString("SELECT id FROM user WHERE id IN (:__id_0,:__id_1)"));
+}
+
+void LibDbUtilTest::sqlTemplateRendersSet()
+{
+    QScopedPointer<SqlTemplate> sqlTemplate(parseTemplate(
+        "<sql id=\"update\">UPDATE user"
+        "  <set>"
+        "    <if test=\"name != null\">name=:name,</if>"
+        "    <if test=\"email != null\">email=:email,</if>"
+        "  </set>"
+        "  WHERE id=:id"
+        "</sql>"));
+
+    QVariantMap params;
+    params["id"] = 7;
+    params["name"] = "tom";
+    QVariantMap bound;
+    // 结尾的逗号被 <set> 去掉
+    QCOMPARE(sqlTemplate->render(params, &bound), QString("UPDATE user SET name=:name WHERE id=:id"));
+    QCOMPARE(bound.size(), 2);
+}
+
+void LibDbUtilTest::bulkWriterChunksByParameterLimit()
+{
+    BulkWriter writer("user", QStringList() << "id" << "name");
+    for (int i = 0; i < 10; ++i) {
+        writer.addRow(QVariantList() << i << QString("user%1").arg(i));
+    }
+
+    // 每条语句最多 6 个参数，也就是 3 行
+    QList<BulkWriter::Statement> statements = writer.statements("QSQLITE", 6, 1024 * 1024);
+    QCOMPARE(statements.size(), 4);
+    QCOMPARE(statements.at(0).rowCount, 3);
+    QCOMPARE(statements.at(1).rowCount, 3);
+    QCOMPARE(statements.at(2).rowCount, 3);
+    QCOMPARE(statements.at(3).rowCount, 1);
+
+    QCOMPARE(statements.at(0).sql,
+             QString("INSERT INTO \"user\" (\"id\", \"name\") VALUES (:p0, :p1), (:p2, :p3), (:p4, :p5)"));
+    // 行数相同的语句文本相同，可以复用 prepare 过的语句
+    QCOMPARE(statements.at(1).sql, statements.at(0).sql);
+    QCOMPARE(statements.at(3).sql, QString("INSERT INTO \"user\" (\"id\", \"name\") VALUES (:p0, :p1)"));
+
+    QCOMPARE(statements.at(0).params.size(), 6);
+    QCOMPARE(statements.at(1).params.value("p0").toInt(), 3);
+    QCOMPARE(statements.at(3).params.value("p0").toInt(), 9);
+    QCOMPARE(statements.at(3).params.value("p1").toString(), QString("user9"));
+
+    // MySQL 使用反引号
+    QVERIFY(writer.statements("QMYSQL", 6, 1024 * 1024).first().sql.startsWith("INSERT INTO `user` (`id`, `name`)"));
+}
+
+void LibDbUtilTest::bulkWriterHalvesChunksOverByteLimit()
+{
+    BulkWriter writer("user", QStringList() << "id" << "name");
+    for (int i = 0; i < 10; ++i) {
+        writer.addRow(QVariantList() << i << QString("user%1").arg(i));
+    }
+
+    // 字节数的上限放不下多行时每条语句一行
+    QList<BulkWriter::Statement> statements = writer.statements("QSQLITE", 6, 0);
+    QCOMPARE(statements.size(), 10);
+    for (const BulkWriter::Statement &statement : statements) {
+        QCOMPARE(statement.rowCount, 1);
+    }
+}
+
+void LibDbUtilTest::bulkWriterRejectsTooManyColumns()
+{
+    BulkWriter writer("user", QStringList() << "id" << "name" << "email");
+    writer.addRow(QVariantList() << 1 << "tom" << "tom@example.com");
+
+    // 一行的列数超过参数的上限时不构造语句
+    QVERIFY(writer.statements("QSQLITE", 2, 1024 * 1024).isEmpty());
+}
+
+void LibDbUtilTest::cursorRoundTrip()
+{
+    QVariantList keys;
+    keys << 42 << QString("tom") << QDateTime(QDate(2026, 10, 16), QTime(10, 20, 30, 123));
+
+    QString cursor = DbUtil::encodeCursor(keys);
+    // base64url，可以直接放在 URL 里
+    QVERIFY(!cursor.contains('+') && !cursor.contains('/') && !cursor.contains('='));
+
+    QVariantList decoded;
+    QVERIFY(DbUtil::decodeCursor(cursor, &decoded));
+    QCOMPARE(decoded, keys);
+    // 类型也保留了
+    QCOMPARE(decoded.at(0).userType(), int(QMetaType::Int));
+}
+
+void LibDbUtilTest::cursorRejectsInvalidInput()
+{
+    QVariantList decoded;
+    QVERIFY(!DbUtil::decodeCursor(QString(), &decoded));
+
+    QString cursor = DbUtil::encodeCursor(QVariantList() << 42 << QString("tom"));
+    QVERIFY(!DbUtil::decodeCursor(cursor.left(cursor.size() - 4), &decoded));
+
+    // 没有 key 的游标无效
+    QVERIFY(!DbUtil::decodeCursor(DbUtil::encodeCursor(QVariantList()), &decoded));
+}
+
+void LibDbUtilTest::queryCacheInvalidatesWrittenTable()
+{
+    QueryCache &cache = Singleton<QueryCache>::getInstance();
+    const QString sql = "SELECT id, name FROM user WHERE id=:id";
+    cache.registerStatement(sql, true, 60000, QStringList() << "user");
+
+    QVariantMap params;
+    params["id"] = 1;
+    ResultSet rs;
+    QueryCache::Ticket ticket;
+    QVERIFY(!cache.lookup(sql, params, &rs, &ticket));
+    QVERIFY(ticket.cacheable);
+    cache.store(ticket, sampleResult());
+
+    QVERIFY(cache.lookup(sql, params, &rs, &ticket));
+    QCOMPARE(rs.getString(0, 1), QString("tom"));
+
+    // 参数的类型不同时是不同的 key
+    QVariantMap stringParams;
+    stringParams["id"] = QString("1");
+    QVERIFY(!cache.lookup(sql, stringParams, &rs, &ticket));
+
+    // 修改其他的表不影响
+    cache.invalidate("UPDATE product SET name=:name WHERE id=:id");
+    QVERIFY(cache.lookup(sql, params, &rs, &ticket));
+
+    // 表名的引号和大小写不影响
+    cache.invalidate("UPDATE `User` SET name=:name WHERE id=:id");
+    QVERIFY(!cache.lookup(sql, params, &rs, &ticket));
+}
+
+void LibDbUtilTest::queryCacheClearsOnMultiTableWrite()
+{
+    QueryCache &cache = Singleton<QueryCache>::getInstance();
+    const QString sql = "SELECT id, name FROM product WHERE id=:id";
+    cache.registerStatement(sql, true, 60000, QStringList() << "product");
+
+    QVariantMap params;
+    params["id"] = 1;
+    ResultSet rs;
+    QueryCache::Ticket ticket;
+    QVERIFY(!cache.lookup(sql, params, &rs, &ticket));
+    cache.store(ticket, sampleResult());
+    QVERIFY(cache.lookup(sql, params, &rs, &ticket));
+
+    // 多表的 UPDATE 解析不出所有修改的表，清空所有缓存
+    cache.invalidate("UPDATE user u JOIN product p ON p.user_id = u.id SET u.name = p.name");
+    QVERIFY(!cache.lookup(sql, params, &rs, &ticket));
+}
+
+void LibDbUtilTest::queryCacheRequiresTables()
+{
+    QueryCache &cache = Singleton<QueryCache>::getInstance();
+    const QString sql = "SELECT COUNT(*) FROM user";
+    cache.registerStatement(sql, true, 60000, QStringList());
+
+    ResultSet rs;
+    QueryCache::Ticket ticket;
+    QVERIFY(!cache.lookup(sql, QVariantMap(), &rs, &ticket));
+    QVERIFY(!ticket.cacheable);
+}
+
+void LibDbUtilTest::poolNeverExceedsMaxConnectionCount()
+{
+    // data/config.json 中 max_connection_count 为 2，max_wait_time 为 200 毫秒
+    ConnectionPool pool(Config::PRIMARY_DATA_SOURCE);
+    const int threadCount = 4;
+    QSemaphore attempted;
+    QSemaphore release;
+    QAtomicInt borrowed;
+    QAtomicInt maxTotal;
+
+    QList<BorrowThread *> threads;
+    for (int i = 0; i < threadCount; ++i) {
+        threads << new BorrowThread(&pool, &attempted, &release, &borrowed, &maxTotal);
+        threads.last()->start();
+    }
+
+    // 两个线程取得连接后一直持有，另外两个等待超时
+    QVERIFY(attempted.tryAcquire(threadCount, 10000));
+    QCOMPARE(borrowed.load(), 2);
+    QVERIFY(maxTotal.load() <= 2);
+    PoolMetrics metrics = pool.metrics();
+    QVERIFY(metrics.totalConnections <= 2);
+    QCOMPARE(metrics.activeConnections, 2);
+    QCOMPARE(metrics.timeoutCount, qint64(threadCount - 2));
+
+    release.release(threadCount);
+    for (BorrowThread *thread : threads) {
+        QVERIFY(thread->wait(10000));
+    }
+    qDeleteAll(threads);
+    pool.release();
+}
+
+QTEST_GUILESS_MAIN(LibDbUtilTest)
+
+#include "tst_libdbutil.moc"
@@ -3,6 +3,7 @@
 
 #include <QString>
 #include <QStringList>
+#include <QJsonObject>
 
 //单例宏中已经申明了构造函数和析构函数，这里直接写函数体即可，无需再次申明
 
@@ -17,59 +18,122 @@ Config::~Config()
     json = NULL;
 }
 
-QString Config::getDatabaseType() const
+const QString Config::PRIMARY_DATA_SOURCE = "primary";
+
+QString Config::databaseKey(const QString &dataSource, const QString &key) const
+{
+    if (!dataSource.isEmpty() && dataSource != PRIMARY_DATA_SOURCE) {
+        QString replicaKey = QString("database.replicas.%1.%2").arg(dataSource).arg(key);
+        if (!json->getJsonValue(replicaKey).isUndefined()) {
+            return replicaKey;
+        }
+    }
+    return "database." + key;
+}
+
+QStringList Config::getDatabaseReplicaNames() const
+{
+    return json->getJsonObject("database.replicas").keys();
+}
+
+QString Config::getDatabaseReadStrategy() const
+{
+    return json->getString("database.read_strategy", "round_robin");
+}
+
+QString Config::getDatabaseType(const QString &dataSource) const
+{
+    return json->getString(databaseKey(dataSource, "type"));
+}
+
+QString Config::getDatabaseHost(const QString &dataSource) const
+{
+    return json->getString(databaseKey(dataSource, "host"));
+}
+
+QString Config::getDatabaseName(const QString &dataSource) const
+{
+    return json->getString(databaseKey(dataSource, "database_name"));
+}
+
+QString Config::getDatabaseUsername(const QString &dataSource) const
+{
+    return json->getString(databaseKey(dataSource, "username"));
+}
+
+QString Config::getDatabasePassword(const QString &dataSource) const
 {
-    return json->getString("database.type");
+    return json->getString(databaseKey(dataSource, "password"));
 }
 
-QString Config::getDatabaseHost() const
+QString Config::getDatabaseTestOnBorrowSql(const QString &dataSource) const
 {
-    return json->getString("database.host");
+    return json->getString(databaseKey(dataSource, "test_on_borrow_sql"), "SELECT 1");
 }
 
-QString Config::getDatabaseName() const
+bool Config::getDatabaseTestOnBorrow(const QString &dataSource) const
 {
-    return json->getString("database.database_name");
+    return json->getBool(databaseKey(dataSource, "test_on_borrow"), false);
 }
 
-QString Config::getDatabaseUsername() const
+int Config::getDatabaseTestOnBorrowIdleTime(const QString &dataSource) const
 {
-    return json->getString("database.username");
+    return json->getInt(databaseKey(dataSource, "test_on_borrow_idle_time"), 5000);
 }
 
-QString Config::getDatabasePassword() const
+bool Config::getDatabaseTestWhileIdle(const QString &dataSource) const
 {
-    return json->getString("database.password");
+    return json->getBool(databaseKey(dataSource, "test_while_idle"), false);
 }
 
-QString Config::getDatabaseTestOnBorrowSql() const
+int Config::getDatabaseIdleTimeout(const QString &dataSource) const
 {
-    return json->getString("database.test_on_borrow_sql", "SELECT 1");
+    return json->getInt(databaseKey(dataSource, "idle_timeout"), 600000);
 }
 
-bool Config::getDatabaseTestOnBorrow() const
+int Config::getDatabaseMaxLifetime(const QString &dataSource) const
 {
-    return json->getBool("database.test_on_borrow", false);
+    return json->getInt(databaseKey(dataSource, "max_lifetime"), 1800000);
 }
 
-int Config::getDatabaseMaxWaitTime() const
+int Config::getDatabaseMaintenanceInterval(const QString &dataSource) const
 {
-    return json->getInt("database.max_wait_time", 5000);
+    return json->getInt(databaseKey(dataSource, "maintenance_interval"), 30000);
 }
 
-int Config::getDatabaseWaitInterval() const
+int Config::getDatabaseMaxWaitTime(const QString &dataSource) const
 {
-    return json->getInt("database.wait_interval_time", 200);
+    return json->getInt(databaseKey(dataSource, "max_wait_time"), 5000);
 }
 
-int Config::getDatabaseMaxConnectionCount() const
+int Config::getDatabaseReclaimIdleWait(const QString &dataSource) const
 {
-    return json->getInt("database.max_connection_count", 5);
+    return json->getInt(databaseKey(dataSource, "reclaim_idle_wait"), -1);
 }
 
-int Config::getDatabaseport() const
+int Config::getDatabaseMaxConnectionCount(const QString &dataSource) const
 {
-    return json->getInt("database.port", 0);
+    return json->getInt(databaseKey(dataSource, "max_connection_count"), 5);
+}
+
+int Config::getDatabaseMinIdle(const QString &dataSource) const
+{
+    return json->getInt(databaseKey(dataSource, "min_idle"), 0);
+}
+
+int Config::getDatabaseStatementCacheSize(const QString &dataSource) const
+{
+    return json->getInt(databaseKey(dataSource, "statement_cache_size"), 64);
+}
+
+int Config::getDatabaseport(const QString &dataSource) const
+{
+    return json->getInt(databaseKey(dataSource, "port"), 0);
+}
+
+QString Config::getDatabaseConnectOptions(const QString &dataSource) const
+{
+    return json->getString(databaseKey(dataSource, "connect_options"));
 }
 
 bool Config::isDatabaseDebug() const
@@ -77,11 +141,96 @@ bool Config::isDatabaseDebug() const
     return json->getBool("database.debug", false);
 }
 
+int Config::getDatabaseAsyncWorkerCount() const
+{
+    return json->getInt("database.async_worker_count", 4);
+}
+
+int Config::getDatabaseAsyncQueueCapacity() const
+{
+    return json->getInt("database.async_queue_capacity", 1000);
+}
+
+int Config::getDatabaseAsyncSubmitTimeout() const
+{
+    return json->getInt("database.async_submit_timeout", 0);
+}
+
+int Config::getDatabaseBatchSize() const
+{
+    return json->getInt("database.batch_size", 1000);
+}
+
+int Config::getDatabaseBulkMaxParameters() const
+{
+    return json->getInt("database.bulk_max_parameters", 0);
+}
+
+int Config::getDatabaseBulkMaxBytes() const
+{
+    return json->getInt("database.bulk_max_bytes", 1048576);
+}
+
+int Config::getDatabaseFetchSize() const
+{
+    return json->getInt("database.fetch_size", 1000);
+}
+
+int Config::getDatabaseResultCacheMaxBytes() const
+{
+    return json->getInt("database.result_cache_max_bytes", 16777216);
+}
+
+int Config::getDatabaseResultCacheTtl() const
+{
+    return json->getInt("database.result_cache_ttl", 60000);
+}
+
+int Config::getDatabaseSlowQueryThreshold() const
+{
+    return json->getInt("database.slow_query_threshold", 1000);
+}
+
+int Config::getDatabaseSlowQuerySamplePercent() const
+{
+    return json->getInt("database.slow_query_sample_percent", 100);
+}
+
+QString Config::getDatabaseSlowQueryLogFile() const
+{
+    return json->getString("database.slow_query_log_file", "log/slow_query.log");
+}
+
+int Config::getDatabaseSlowQueryLogMaxBytes() const
+{
+    return json->getInt("database.slow_query_log_max_bytes", 10485760);
+}
+
+int Config::getDatabaseSlowQueryLogMaxFiles() const
+{
+    return json->getInt("database.slow_query_log_max_files", 5);
+}
+
+bool Config::isDatabaseStatementStats() const
+{
+    return json->getBool("database.statement_stats", true);
+}
+
 QStringList Config::getDatabaseSqlFiles() const
 {
     return json->getStringList("database.sql_files");
 }
 
+QString Config::getDatabaseSqlBundle() const
+{
+    return json->getString("database.sql_bundle", "");
+}
+
+bool Config::isDatabaseSqlHotReload() const
+{
+    return json->getBool("database.sql_hot_reload", false);
+}
+
 QStringList Config::getQssFiles() const
 {
     return json->getStringList("qss_files");
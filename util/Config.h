@@ -3,7 +3,8 @@
 
 #include "util/Singleton.h"
 
-class QString;
+#include <QString>
+
 class QStringList;
 class Json;
 
@@ -11,6 +12,14 @@ class Json;
 /**
  * 用于读写配置文件:
  * 1. data/config.json: 存储配置的信息，例如数据库信息，QSS 文件的路径
+ *
+ * 数据源: database 下的配置是主库（名字为 primary），database.replicas 下可以定义多个读库，
+ * key 是读库的名字（不能包含 "."），读库里没有定义的配置项使用主库的配置，例如
+ *     "replicas": {
+ *         "replica1": { "host": "192.168.1.11" },
+ *         "replica2": { "host": "192.168.1.12", "max_connection_count": 10 }
+ *     }
+ * 连接相关的配置项可以传入数据源的名字读取，为空时读取主库的配置。
  */
 class Config
 {
@@ -18,37 +27,97 @@ class Config
 public:
     //获取数据库配置信息
 
+    // 主库的名字
+    static const QString PRIMARY_DATA_SOURCE;
+    // 所有读库的名字
+    QStringList getDatabaseReplicaNames() const;
+    // 选择读库的策略: round_robin 轮询，least_busy 选正在使用的连接最少的
+    QString getDatabaseReadStrategy() const;
+
     // 数据库的类型, 如QPSQL, QSQLITE, QMYSQL
-    QString getDatabaseType() const;
+    QString getDatabaseType(const QString &dataSource = QString()) const;
     // 数据库主机的IP
-    QString getDatabaseHost() const;
+    QString getDatabaseHost(const QString &dataSource = QString()) const;
     // 数据库名
-    QString getDatabaseName() const;
+    QString getDatabaseName(const QString &dataSource = QString()) const;
     // 登录数据库的用户名
-    QString getDatabaseUsername() const;
+    QString getDatabaseUsername(const QString &dataSource = QString()) const;
     // 登录数据库的密码
-    QString getDatabasePassword() const;
+    QString getDatabasePassword(const QString &dataSource = QString()) const;
     // 验证连接的 SQL
-    QString getDatabaseTestOnBorrowSql() const;
+    QString getDatabaseTestOnBorrowSql(const QString &dataSource = QString()) const;
     // 是否验证连接
-    bool getDatabaseTestOnBorrow() const;
+    bool getDatabaseTestOnBorrow(const QString &dataSource = QString()) const;
+    // 连接空闲超过多少毫秒后，取得连接时才验证，为 0 时每次取得连接都验证
+    int getDatabaseTestOnBorrowIdleTime(const QString &dataSource = QString()) const;
+    // 是否由后台线程定时验证空闲的连接
+    bool getDatabaseTestWhileIdle(const QString &dataSource = QString()) const;
+    // 连接空闲超过多少毫秒后关闭，为 0 时不关闭
+    int getDatabaseIdleTimeout(const QString &dataSource = QString()) const;
+    // 连接建立超过多少毫秒后关闭，为 0 时不限制
+    int getDatabaseMaxLifetime(const QString &dataSource = QString()) const;
+    // 后台维护线程检查空闲连接的间隔
+    int getDatabaseMaintenanceInterval(const QString &dataSource = QString()) const;
     // 线程获取连接最大等待时间
-    int getDatabaseMaxWaitTime() const;
-    //等待测试连接间隔
-    int getDatabaseWaitInterval() const;
+    int getDatabaseMaxWaitTime(const QString &dataSource = QString()) const;
+    // 达到最大连接数时等待多少毫秒后才关闭其他线程的空闲连接给自己建立连接，为负数（默认）时不关闭
+    int getDatabaseReclaimIdleWait(const QString &dataSource = QString()) const;
     // 最大连接数
-    int getDatabaseMaxConnectionCount() const;
+    int getDatabaseMaxConnectionCount(const QString &dataSource = QString()) const;
+    // 启动时预先建立的空闲连接数
+    int getDatabaseMinIdle(const QString &dataSource = QString()) const;
+    // 每个连接缓存的 prepare 过的语句数，为 0 时不缓存
+    int getDatabaseStatementCacheSize(const QString &dataSource = QString()) const;
     // 数据库的端口号
-    int getDatabaseport() const;
+    int getDatabaseport(const QString &dataSource = QString()) const;
+    // 驱动的连接选项，例如 QOCI 的 QOCI_PREFETCH_ROWS=1000，参考 QSqlDatabase::setConnectOptions()
+    QString getDatabaseConnectOptions(const QString &dataSource = QString()) const;
     // 是否打印出执行的 SQL 语句和参数
     bool isDatabaseDebug() const;
+    // 执行异步 SQL 的工作线程数
+    int getDatabaseAsyncWorkerCount() const;
+    // 异步 SQL 任务队列的最大长度
+    int getDatabaseAsyncQueueCapacity() const;
+    // 任务队列满时提交任务最多等待的毫秒数，为 0 时不等待直接拒绝
+    int getDatabaseAsyncSubmitTimeout() const;
+    // 批量执行时每次 execBatch 绑定的最大行数
+    int getDatabaseBatchSize() const;
+    // 多行 INSERT 每条语句参数个数的上限，为 0 时使用驱动的默认值
+    int getDatabaseBulkMaxParameters() const;
+    // 多行 INSERT 每条语句估计的字节数的上限，应小于 MySQL 的 max_allowed_packet
+    int getDatabaseBulkMaxBytes() const;
+    // 分块读取查询结果时每块的行数
+    int getDatabaseFetchSize() const;
+    // 查询结果缓存占用内存的上限（字节），为 0 时不缓存
+    int getDatabaseResultCacheMaxBytes() const;
+    // 查询结果默认缓存的毫秒数
+    int getDatabaseResultCacheTtl() const;
+    // 慢查询的阈值（毫秒），为负数时不记录慢查询
+    int getDatabaseSlowQueryThreshold() const;
+    // 记录慢查询的比例（百分数）
+    int getDatabaseSlowQuerySamplePercent() const;
+    // 慢查询日志文件
+    QString getDatabaseSlowQueryLogFile() const;
+    // 慢查询日志文件超过这个字节数时轮转
+    int getDatabaseSlowQueryLogMaxBytes() const;
+    // 轮转后保留的旧日志文件数
+    int getDatabaseSlowQueryLogMaxFiles() const;
+    // 是否按语句汇总执行统计
+    bool isDatabaseStatementStats() const;
     // SQL 语句文件, 可以是多个
     QStringList getDatabaseSqlFiles() const;
+    // 预编译的 SQL 包，为空时每次启动都解析 SQL 文件
+    QString getDatabaseSqlBundle() const;
+    // 是否监视 SQL 文件，修改后自动重新加载
+    bool isDatabaseSqlHotReload() const;
 
     //QSS 样式表文件, 可以是多个
     QStringList getQssFiles() const;
 
 private:
+    // 数据源的配置项在 config.json 里的路径，读库没有定义的配置项使用主库的
+    QString databaseKey(const QString &dataSource, const QString &key) const;
+
     Json *json;
 
 };
@@ -7,15 +7,15 @@
 /**
  * 使用方法:
  * 1. 定义类为单例:
- *     class ConnectionPool {
- *         SINGLETON(ConnectionPool) // Here
+ *     class DataSourceManager {
+ *         SINGLETON(DataSourceManager) // Here
  *     public:
  *
  * 2. 获取单例类的对象:
- *     Singleton<ConnectionPool>::getInstance();
- *     ConnectionPool &pool = Singleton<ConnectionPool>::getInstance();
+ *     Singleton<DataSourceManager>::getInstance();
+ *     DataSourceManager &manager = Singleton<DataSourceManager>::getInstance();
  * 注意: 如果单例的类需要释放的资源和 Qt 底层的信号系统有关系，例如 QSettings，QSqlDatabase 等，
- *     需要在程序结束前手动释放(也就是在 main() 函数返回前调用释放资源的函数，参考 ConnectionPool 的调用)，
+ *     需要在程序结束前手动释放(也就是在 main() 函数返回前调用释放资源的函数，参考 DataSourceManager 的调用)，
  *     否则有可能在程序退出时报系统底层的信号错误，导致如 QSettings 的数据没有保存。
  */
 template <typename T>